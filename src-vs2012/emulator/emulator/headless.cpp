@@ -0,0 +1,129 @@
+// headless.cpp : command line front end that runs the emulator without video, input or frame rate limit.
+//
+
+#include "stdafx.h"
+
+// local header files
+#include "macros.h"
+#include "types/types.h"
+#include "unittest/framework.h"
+
+#include "nes/internals.h"
+#include "nes/debug.h"
+#include "nes/rom.h"
+#include "nes/mmc.h"
+#include "nes/cpu.h"
+#include "nes/ppu.h"
+#include "nes/emu.h"
+
+#include "ui.h"
+
+static void usage(const char* self_path)
+{
+	printf("usage: %s [--test] [--jit] [--checked] [--frameskip <n>] [--frames <n>] [--seconds <s>] [--log <file>] <nes file path>\n", self_path);
+	printf("  --jit  run hot code as call-threaded blocks (x86-64)\n");
+}
+
+int main(int argc, char* argv[])
+{
+	const char* romFile = nullptr;
+	const char* logFile = nullptr;
+	long long frames = -1;
+	double seconds = -1;
+	bool runTests = false;
+	bool useJIT = false;
+	bool checked = false;
+	int frameSkip = 0;
+
+	// parse command line
+	for (int i=1;i<argc;i++)
+	{
+		if (strcmp(argv[i], "--test")==0)
+		{
+			runTests = true;
+		}else if (strcmp(argv[i], "--jit")==0)
+		{
+			useJIT = true;
+		}else if (strcmp(argv[i], "--checked")==0)
+		{
+			checked = true;
+		}else if (strcmp(argv[i], "--frameskip")==0 && i+1<argc)
+		{
+			frameSkip = max(atoi(argv[++i]), 0);
+		}else if (strcmp(argv[i], "--frames")==0 && i+1<argc)
+		{
+			frames = atoll(argv[++i]);
+		}else if (strcmp(argv[i], "--seconds")==0 && i+1<argc)
+		{
+			seconds = atof(argv[++i]);
+		}else if (strcmp(argv[i], "--log")==0 && i+1<argc)
+		{
+			logFile = argv[++i];
+		}else if (argv[i][0]!='-' && romFile==nullptr)
+		{
+			romFile = argv[i];
+		}else
+		{
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (runTests)
+	{
+		const TestResult result = TestFramework::instance().runAll();
+		TestFramework::destroy();
+		return (result==SUCCESS)?0:1;
+	}
+
+	if (romFile==nullptr)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+	if (frames<0 && seconds<0)
+	{
+		// default budget
+		frames = 60;
+	}
+
+	int ret = 0;
+	ui::init();
+	emu::init();
+	emu::reset();
+	emu::enableJIT(useJIT);
+	emu::enableChecks(checked);
+	emu::setFrameSkip(frameSkip);
+	if (emu::load(romFile) && emu::setup())
+	{
+		FILE *fp = nullptr;
+		if (logFile!=nullptr)
+		{
+			fp = fopen(logFile, "wt");
+			if (fp!=nullptr) debug::setOutputFile(fp);
+		}
+
+		ui::onGameStart();
+		const BATCHSTATS stats = emu::runBatch(frames, seconds);
+		ui::onGameEnd();
+
+		// report throughput
+		const double t = (stats.seconds>0)?stats.seconds:1e-9;
+		printf("[ ] %lld frames, %lld cycles, %lld instructions in %.3f s\n", stats.frames, stats.cycles, stats.instructions, stats.seconds);
+		printf("[ ] %.1f fps, %.0f cycles/s, %.0f instructions/s\n", stats.frames/t, stats.cycles/t, stats.instructions/t);
+
+		if (fp!=nullptr)
+		{
+			debug::setOutputFile(stdout);
+			fclose(fp);
+		}
+	}else
+	{
+		puts("[X] Unable to emulate the rom.");
+		ret = 1;
+	}
+	emu::deinit();
+	ui::deinit();
+	TestFramework::destroy();
+	return ret;
+}
@@ -56,6 +56,19 @@ public:
 #define UPDATE_FIELD(x, f, y) x=((x)&(~f))|(((y)*LOW_BIT(f))&(f))
 #define INC_FIELD(x, f) x=((x)&(~(f))) | ( (((x)&(f)) + LOW_BIT(f)) & (f) );
 
+// compiler specific
+#ifdef _MSC_VER
+	#define THREAD_LOCAL __declspec(thread)
+	#define FORCE_INLINE __forceinline
+	#define EXTERN_INLINE __forceinline
+	#define DEBUG_BREAK() __debugbreak()
+#else
+	#define THREAD_LOCAL __thread
+	#define FORCE_INLINE inline __attribute__((always_inline))
+	#define EXTERN_INLINE // gcc can't inline across translation units anyway
+	#define DEBUG_BREAK() __builtin_trap()
+#endif
+
 // type casting
 template <typename destType, typename srcType>
 inline destType& safe_cast(srcType& source)
@@ -89,4 +102,4 @@ inline T max(const T& x,const T& y) {return x>y?x:y;}
 template <typename T1, typename T2>
 inline size_t ptr_diff(const T1* x, const T2* y) {return reinterpret_cast<const volatile char*>(x)-reinterpret_cast<const volatile char*>(y);}
 
-#define CASE_ENUM_RETURN_STRING(ENUM) case ENUM: return L#ENUM
+#define CASE_ENUM_RETURN_STRING(ENUM) case ENUM: return #ENUM
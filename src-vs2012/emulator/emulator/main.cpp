@@ -10,6 +10,10 @@
 
 #include "nes/internals.h"
 #include "nes/debug.h"
+#include "nes/rom.h"
+#include "nes/mmc.h"
+#include "nes/cpu.h"
+#include "nes/ppu.h"
 #include "nes/emu.h"
 
 #include "ui.h"
@@ -21,7 +25,7 @@ static void welcome()
 
 static void usage(_TCHAR* self_path)
 {
-	// _tprintf(_T("%s <nes file path>\n"), self_path);
+	// _tprintf(_T("%s <nes file path> [log file path]\n"), self_path);
 }
 
 
@@ -36,14 +40,22 @@ int _cdecl _tmain(int argc, _TCHAR* argv[])
 	{
 		// reset emulator
 		emu::reset();
+#ifdef _DEBUG
+		// debug builds run every instruction through the checked cpu handlers
+		emu::enableChecks(true);
+#endif
 		if (emu::load(argv[1]))
 		{
 			// setup emulator
 			if (emu::setup())
 			{
-				// create log file
-				FILE *fp = fopen("m:\\log.txt", "wt");
-				debug::setOutputFile(fp);
+				// create log file (optional)
+				FILE *fp = nullptr;
+				if (argc>=3)
+				{
+					_tfopen_s(&fp, argv[2], _T("wt"));
+					if (fp!=nullptr) debug::setOutputFile(fp);
+				}
 
 				// start execution
 				ui::onGameStart();
@@ -51,7 +63,11 @@ int _cdecl _tmain(int argc, _TCHAR* argv[])
 
 				ui::onGameEnd();
 
-				fclose(fp);
+				if (fp!=nullptr)
+				{
+					debug::setOutputFile(stdout);
+					fclose(fp);
+				}
 			}else
 			{
 				puts("[X] Unable to emulate the rom.");
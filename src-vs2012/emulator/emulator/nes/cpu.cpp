@@ -7,37 +7,36 @@
 
 #include "internals.h"
 #include "debug.h"
+#include "rom.h"
 #include "mmc.h"
 #include "opcodes.h"
 #include "cpu.h"
+#include "ppu.h"
+#include "emu.h"
+#include "jit.h"
+#include "testrom.h"
 
-// Register file
-__declspec(align(32)) // try to make registers fit into a cache line of host CPU
-static _reg8_t		A; // accumulator
-static _reg8_t		X, Y; // index
-static maddr8_t		SP; // stack pointer
-static flag_set<_reg8_t, PSW, 8> P; // status
-static maddr_t		PC; // program counter
+// Register file and counters (owned by the active machine)
+static FORCE_INLINE CPUSTATE& cpuState()
+{
+	return emu::active().cpu;
+}
 
-static maddr_t		addr; // effective address
+#define addr	(emu::active().cpu.addr) // effective address
 #define EA addr
 
-static byte_t		value; // operand
-static _alutemp_t	temp;
+#define value	(emu::active().cpu.value) // operand
+#define temp	(emu::active().cpu.temp)
 
 // alias of registers with wrapping
 typedef bit_field<_reg8_t, 8> reg_bit_field_t;
-#define regA fast_cast(A, reg_bit_field_t)
-#define regX fast_cast(X, reg_bit_field_t)
-#define regY fast_cast(Y, reg_bit_field_t)
+#define regA fast_cast(cpuState().A, reg_bit_field_t)
+#define regX fast_cast(cpuState().X, reg_bit_field_t)
+#define regY fast_cast(cpuState().Y, reg_bit_field_t)
 #define M fast_cast(value, operandb_t)
 #define SUM fast_cast(temp, alu_t)
 
-// Interrupts
-static flag_set<_reg8_t, IRQTYPE, 8> pendingIRQs;
-
 // Run-time statistics
-static long remainingCycles;
 #ifdef WANT_STATISTICS
 	static long long totInstructions;
 	static long long totCycles;
@@ -54,19 +53,24 @@ static long remainingCycles;
 	static bool instructionHit[0x8000];
 #endif
 
+// compiled blocks bypass the per-instruction debugging hooks, so these stay build switches that leave the JIT out
+#if defined(WANT_JIT) && (defined(MONITOR_CPU) || defined(WANT_RUN_HIT) || defined(WANT_STATISTICS))
+	#undef WANT_JIT
+#endif
+
 namespace stack
 {
 	static inline void pushByte(const byte_t byte)
 	{
 #ifdef MONITOR_STACK
-		printf("[S] Push 0x%02X to $%02X\n",byte,valueOf(SP));
+		printf("[S] Push 0x%02X to $%02X\n",byte,valueOf(cpuState().SP));
 #endif
 
-		ramSt[SP]=byte;
+		ramSt[cpuState().SP]=byte;
 
-		dec(SP);
+		dec(cpuState().SP);
 #ifndef ALLOW_ADDRESS_WRAP
-		ERROR_IF(SP.reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
+		ERROR_IF(cpuState().SP.reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
 #endif
 	}
 
@@ -77,80 +81,93 @@ namespace stack
 
 	static inline void pushWord(const word_t word)
 	{
-		dec(SP);
+		dec(cpuState().SP);
 #ifdef MONITOR_STACK
-		printf("[S] Push 0x%04X to $%02X\n",word,valueOf(SP));
+		printf("[S] Push 0x%04X to $%02X\n",word,valueOf(cpuState().SP));
 #endif
-		FATAL_ERROR_IF(SP.reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
+		FATAL_ERROR_IF(cpuState().SP.reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
 
-		*(uint16_t*)&(ramSt[SP])=(word);
+		*(uint16_t*)&(ramSt[cpuState().SP])=(word);
 
-		dec(SP);
+		dec(cpuState().SP);
 #ifndef ALLOW_ADDRESS_WRAP
-		ERROR_IF(SP.reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
+		ERROR_IF(cpuState().SP.reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
 #endif
 	}
 
 	static inline void pushPC()
 	{
-		pushWord(PC);
+		pushWord(cpuState().PC);
 	}
 
 	static inline byte_t popByte()
 	{
 #ifndef ALLOW_ADDRESS_WRAP
-		ERROR_IF(SP.reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
+		ERROR_IF(cpuState().SP.reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
 #endif
-		return ramSt[inc(SP)];
+		return ramSt[inc(cpuState().SP)];
 	}
 
 	static inline word_t popWord()
 	{
 #ifndef ALLOW_ADDRESS_WRAP
-		ERROR_IF(SP.plus(1).reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
+		ERROR_IF(cpuState().SP.plus(1).reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
 #endif
-		FATAL_ERROR_UNLESS(SP.belowMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
+		FATAL_ERROR_UNLESS(cpuState().SP.belowMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
 
-		SP+=2;
-		return *(uint16_t*)&(ramSt[SP.minus(1)]);
+		cpuState().SP+=2;
+		return *(uint16_t*)&(ramSt[cpuState().SP.minus(1)]);
 	}
 
 	static void reset()
 	{
 		// move stack pointer to the top of the stack
-		SP.selfSetMax();
+		cpuState().SP.selfSetMax();
 
 		// clear stack
 		memset(ramSt, 0, sizeof(ramSt));
 	}
 }
 
+// N and Z are set by almost every instruction and read by few, so only the result they follow is kept.
+// P holds them after flush() only, anything reading or writing P as a whole has to go through flush() or reload().
 namespace status
 {
 	template <class T,int bits>
-	static inline void setZ(const bit_field<T,bits>& result)
+	static inline void setNZ(const bit_field<T,bits>& result)
 	{
-		P.change<F_ZERO>(result.zero());
+		STATIC_ASSERT(bits==8);
+		cpuState().nz=valueOf(result);
 	}
 
-	template <class T,int bits>
-	static inline void setN(const bit_field<T,bits>& result)
+	// BIT takes N from the operand and Z from the operand and A
+	static inline void setBIT(const byte_t operand, const byte_t accumulator)
 	{
-		P.change<F_NEGATIVE>(result.negative());
+		cpuState().P.change<F_OVERFLOW>((operand>>6)&1);
+		cpuState().nz=(operand&accumulator)|((operand&0x80)<<1);
 	}
 
-	template <class T,int bits>
-	static inline void setNZ(const bit_field<T,bits>& result)
+	static inline bool negative()
 	{
-		P.change<F_NEGATIVE>(result.negative());
-		P.change<F_ZERO>(result.zero());
+		return (cpuState().nz&0x180)!=0;
 	}
 
-	template <class T,int bits>
-	static inline void setNV(const bit_field<T,bits>& result)
+	static inline bool zero()
 	{
-		STATIC_ASSERT((int)F_NEGATIVE == 1<<7 && (int)F_OVERFLOW == 1<<6);
-		P.copy<F__NV, 6, 2>(result);
+		return (cpuState().nz&0xFF)==0;
+	}
+
+	// copy N and Z into P
+	static inline void flush()
+	{
+		cpuState().P.change<F_NEGATIVE>(negative());
+		cpuState().P.change<F_ZERO>(zero());
+	}
+
+	// take N and Z from P once it has been written as a whole
+	static inline void reload()
+	{
+		cpuState().nz=(cpuState().P[F_ZERO]?0:1)|(cpuState().P[F_NEGATIVE]?0x100:0);
 	}
 }
 
@@ -162,21 +179,21 @@ namespace interrupt
 
 	static void clearAll()
 	{
-		pendingIRQs.clearAll();
+		cpuState().pendingIRQs.clearAll();
 	}
 
 	static void clear(IRQTYPE type)
 	{
-		assert(pendingIRQs[type]);
-		pendingIRQs.clear(type);
+		assert(cpuState().pendingIRQs[type]);
+		cpuState().pendingIRQs.clear(type);
 	}
 
 	void request(const IRQTYPE type)
 	{
 		vassert(type != IRQTYPE::NONE);
-		ERROR_IF(pendingIRQs[type], ILLEGAL_OPERATION, IRQ_ALREADY_PENDING);
+		ERROR_IF(cpuState().pendingIRQs[type], ILLEGAL_OPERATION, IRQ_ALREADY_PENDING);
 
-		pendingIRQs.set(type);
+		cpuState().pendingIRQs.set(type);
 		STAT_ADD(totInterrupts, 1);
 	}
 
@@ -201,22 +218,22 @@ namespace interrupt
 
 	static bool pending()
 	{
-		return pendingIRQs.any();
+		return cpuState().pendingIRQs.any();
 	}
 
 	static bool pending(const IRQTYPE type)
 	{
 		vassert(type != IRQTYPE::NONE);
-		return pendingIRQs[type];
+		return cpuState().pendingIRQs[type];
 	}
 
 	// return the highest-priority IRQ that is currently pending
 	static IRQTYPE current()
 	{
-		if (pendingIRQs[IRQTYPE::RST]) return IRQTYPE::RST;
-		if (pendingIRQs[IRQTYPE::NMI]) return IRQTYPE::NMI;
-		if (pendingIRQs[IRQTYPE::IRQ]) return IRQTYPE::IRQ;
-		if (pendingIRQs[IRQTYPE::BRK]) return IRQTYPE::BRK;
+		if (cpuState().pendingIRQs[IRQTYPE::RST]) return IRQTYPE::RST;
+		if (cpuState().pendingIRQs[IRQTYPE::NMI]) return IRQTYPE::NMI;
+		if (cpuState().pendingIRQs[IRQTYPE::IRQ]) return IRQTYPE::IRQ;
+		if (cpuState().pendingIRQs[IRQTYPE::BRK]) return IRQTYPE::BRK;
 		return IRQTYPE::NONE;
 	}
 
@@ -225,7 +242,7 @@ namespace interrupt
 		if (pending())
 		{
 			IRQTYPE irq = current();
-			if (irq != IRQTYPE::IRQ || !P[F_INTERRUPT_OFF])
+			if (irq != IRQTYPE::IRQ || !cpuState().P[F_INTERRUPT_OFF])
 			{
 				// process IRQ
 				stack::pushPC();
@@ -233,16 +250,17 @@ namespace interrupt
 				{
 					// set or clear Break flag depending on irq type
 					if (irq == IRQTYPE::BRK)
-						P|=F_BREAK;
+						cpuState().P|=F_BREAK;
 					else
-						P-=F_BREAK;
+						cpuState().P-=F_BREAK;
 					// push status
-					stack::pushReg(P);
+					status::flush();
+					stack::pushReg(cpuState().P);
 					// disable other interrupts
-					P|=F_INTERRUPT_OFF;
+					cpuState().P|=F_INTERRUPT_OFF;
 				}
 				// jump to interrupt handler
-				PC = handler(irq);
+				cpuState().PC = handler(irq);
 				clear(irq);
 			}
 		}
@@ -254,7 +272,7 @@ namespace bitshift
 	template <class T,int bits>
 	static inline void ASL(bit_field<T,bits>& operand) {
 		// Arithmetic Shift Left
-		P.change<F_CARRY>(MSB(operand));
+		cpuState().P.change<F_CARRY>(MSB(operand));
 		operand.selfShl1();
 		status::setNZ(operand);
 	}
@@ -262,18 +280,17 @@ namespace bitshift
 	template <class T,int bits>
 	static inline void LSR(bit_field<T,bits>& operand) {
 		// Logical Shift Right
-		P.change<F_CARRY>(LSB(operand));
+		cpuState().P.change<F_CARRY>(LSB(operand));
 		operand.selfShr1();
-		status::setZ(operand);
-		P.clear(F_SIGN);
+		status::setNZ(operand);
 	}
 
 	template <class T,int bits>
 	static inline void ROL(bit_field<T,bits>& operand) {
 		// Rotate Left With Carry
 		const bool newCarry=MSB(operand);
-		operand.selfRcl(P[F_CARRY]);
-		P.change<F_CARRY>(newCarry);
+		operand.selfRcl(cpuState().P[F_CARRY]);
+		cpuState().P.change<F_CARRY>(newCarry);
 		status::setNZ(operand);
 	}
 
@@ -281,8 +298,8 @@ namespace bitshift
 	static inline void ROR(bit_field<T,bits>& operand) {
 		// Rotate Right With Carry
 		const bool newCarry=LSB(operand);
-		operand.selfRcr(P[F_CARRY]);
-		P.change<F_CARRY>(newCarry);
+		operand.selfRcr(cpuState().P[F_CARRY]);
+		cpuState().P.change<F_CARRY>(newCarry);
 		status::setNZ(operand);
 	}
 }
@@ -293,41 +310,41 @@ namespace arithmetic
 	{
 		// Add with carry. A <- [A]+[M]+C
 #ifdef WANT_BCD
-		if (P[F_BCD])
+		if (cpuState().P[F_BCD])
 		{
 			// bcd addition
-			assert((A&0xF)<=9 && (A>>4)<=9);
+			assert((cpuState().A&0xF)<=9 && (cpuState().A>>4)<=9);
 			assert((value&0xF)<=9 && (value>>4)<=9);
 			// add CF
-			temp=A+(P[F_CARRY]?1:0);
+			temp=cpuState().A+(cpuState().P[F_CARRY]?1:0);
 
 			// add low digit
 			if ((temp&0xF)+(value&0xF)>9)
 			{
 				temp+=(value&0xF)+6;
-				P|=F_CARRY;
+				cpuState().P|=F_CARRY;
 			}else
 			{
 				temp+=(value&0xF);
-				P-=F_CARRY;
+				cpuState().P-=F_CARRY;
 			}
 			if ((temp>>4)+(value>>4)>9)
 			{
 				temp+=(value&0xF0)+6;
-				P|=F_OVERFLOW;
-				P|=F_CARRY;
+				cpuState().P|=F_OVERFLOW;
+				cpuState().P|=F_CARRY;
 			}else
 			{
 				temp+=(value&0xF0);
-				P-=F_OVERFLOW;
+				cpuState().P-=F_OVERFLOW;
 			}
 		}else
 #endif
 		{
 			// binary addition
-			temp=A+value+(P[F_CARRY]?1:0);
-			P.change<F_OVERFLOW>(!((A^value)&0x80) && ((A^temp)&0x80));
-			P.change<F_CARRY>(SUM.overflow());
+			temp=cpuState().A+value+(cpuState().P[F_CARRY]?1:0);
+			cpuState().P.change<F_OVERFLOW>(!((cpuState().A^value)&0x80) && ((cpuState().A^temp)&0x80));
+			cpuState().P.change<F_CARRY>(SUM.overflow());
 		}
 		status::setNZ(regA(temp));
 	}
@@ -336,12 +353,12 @@ namespace arithmetic
 	{
 #ifdef WANT_BCD_MODE
 		// SBC is currently impossible in decimal mode
-		assert(!P[F_BCD]);
+		assert(!cpuState().P[F_BCD]);
 #endif
-		temp=A-value-(P[F_CARRY]?0:1);
+		temp=cpuState().A-value-(cpuState().P[F_CARRY]?0:1);
 
-		P.change<F_CARRY>(!SUM.overflow());
-		P.change<F_OVERFLOW>(((A^value)&0x80) && ((A^temp)&0x80));
+		cpuState().P.change<F_CARRY>(!SUM.overflow());
+		cpuState().P.change<F_OVERFLOW>(((cpuState().A^value)&0x80) && ((cpuState().A^temp)&0x80));
 
 		status::setNZ(regA(temp));
 	}
@@ -352,15 +369,16 @@ namespace cpu
 	void reset()
 	{
 		// reset general purpose registers
-		A=0;
-		X=0;
-		Y=0;
-		PC=0;
+		cpuState().A=0;
+		cpuState().X=0;
+		cpuState().Y=0;
+		cpuState().PC=0;
 
 		// reset status register
-		P.clearAll();
-		P.set(F_RESERVED);
-		P.set(F_INTERRUPT_OFF);
+		cpuState().P.clearAll();
+		cpuState().P.set(F_RESERVED);
+		cpuState().P.set(F_INTERRUPT_OFF);
+		status::reload();
 
 		// reset stack pointer
 		stack::reset();
@@ -370,7 +388,10 @@ namespace cpu
 		// this will set PC to the entry point
 		interrupt::request(IRQTYPE::RST);
 
-		remainingCycles = 0;
+		cpuState().remainingCycles = 0;
+		cpuState().cycleCount = 0;
+		cpuState().instructionCount = 0;
+		cpuState().lastLoop.head = nullptr;
 		// others
 #ifdef WANT_RUN_HIT
 		for (int i=0;i<0x8000;i++)
@@ -378,28 +399,39 @@ namespace cpu
 #endif
 	}
 
-	void save(FILE *fp)
+	void save(SNAPSHOT& s)
 	{
-		// registers
-		fwrite(&A, sizeof(A), 1, fp);
-		fwrite(&X, sizeof(X), 1, fp);
-		fwrite(&Y, sizeof(Y), 1, fp);
-		fwrite(&SP, sizeof(SP), 1, fp);
-		fwrite(&P, sizeof(P), 1, fp);
-		fwrite(&PC, sizeof(PC), 1, fp);
-		fwrite(&pendingIRQs, sizeof(pendingIRQs), 1, fp);
+		// registers, interrupts and counters
+		status::flush();
+		const CPUSTATE& state=cpuState();
+		s.cpu.cycleCount=state.cycleCount;
+		s.cpu.instructionCount=state.instructionCount;
+		s.cpu.remainingCycles=state.remainingCycles;
+		s.cpu.PC=(uint16_t)valueOf(state.PC);
+		s.cpu.A=(uint8_t)state.A;
+		s.cpu.X=(uint8_t)state.X;
+		s.cpu.Y=(uint8_t)state.Y;
+		s.cpu.SP=(uint8_t)valueOf(state.SP);
+		s.cpu.P=(uint8_t)valueOf(state.P);
+		s.cpu.pendingIRQs=(uint8_t)valueOf(state.pendingIRQs);
 	}
 	
-	void load(FILE *fp)
+	void load(const SNAPSHOT& s)
 	{
-		// registers
-		fread(&A, sizeof(A), 1, fp);
-		fread(&X, sizeof(X), 1, fp);
-		fread(&Y, sizeof(Y), 1, fp);
-		fread(&SP, sizeof(SP), 1, fp);
-		fread(&P, sizeof(P), 1, fp);
-		fread(&PC, sizeof(PC), 1, fp);
-		fread(&pendingIRQs, sizeof(pendingIRQs), 1, fp);
+		// decoded and compiled code stays valid as it only depends on the rom
+		CPUSTATE& state=cpuState();
+		state.cycleCount=s.cpu.cycleCount;
+		state.instructionCount=s.cpu.instructionCount;
+		state.remainingCycles=(long)s.cpu.remainingCycles;
+		state.PC=s.cpu.PC;
+		state.A=s.cpu.A;
+		state.X=s.cpu.X;
+		state.Y=s.cpu.Y;
+		state.SP=s.cpu.SP;
+		state.P.asBitField()=s.cpu.P;
+		status::reload();
+		state.pendingIRQs.asBitField()=s.cpu.pendingIRQs;
+		state.lastLoop.head=nullptr;
 	}
 
 	void dump()
@@ -417,15 +449,27 @@ namespace cpu
 #endif
 	}
 
+#ifdef WANT_JIT
+	static bool runCompiled();
+#endif
+	static void skipIdleLoop(const maddr_t head);
+
 	// emulate at most n instructions within specified cycles
 	bool run(int n, long cycles)
 	{
-		remainingCycles+=cycles;
-		while ((n<0 || n--) && remainingCycles>0)
+		cpuState().remainingCycles+=cycles;
+		// what an idle loop read before may have changed since
+		cpuState().lastLoop.head=nullptr;
+#ifdef WANT_JIT
+		if (n<0 && cpuState().jit.enabled) return runCompiled();
+#endif
+		while ((n<0 || n--) && cpuState().remainingCycles>0)
 		{
+			const maddr_t pc=cpuState().PC;
 			int cyc;
 			cyc=nextInstruction();
 			if (cyc<0) return false; // execution terminated
+			if (n<0 && valueOf(cpuState().PC)<=valueOf(pc)) skipIdleLoop(cpuState().PC);
 		}
 		return true;
 	}
@@ -435,51 +479,75 @@ namespace cpu
 		interrupt::request(type);
 	}
 
-	static int readEffectiveAddress(const opcode_t code, const M6502_OPCODE op, bool forWriteOnly = false)
+	long long cycleCount()
+	{
+		return cpuState().cycleCount;
+	}
+
+	long long instructionCount()
+	{
+		return cpuState().instructionCount;
+	}
+
+	long long cycleBudget()
+	{
+		return cpuState().cycleCount+cpuState().remainingCycles;
+	}
+
+	// makes the current run() return once the budget is used up, if that is sooner
+	void limitCycleBudget(const long long budget)
+	{
+		const long long excess=cycleBudget()-budget;
+		if (excess>0) cpuState().remainingCycles-=(long)excess;
+	}
+
+	// addressing mode is a template argument, so the switch below is resolved at compile time
+	template <M6502_ADDRMODE adrmode>
+	static FORCE_INLINE int readEffectiveAddress(const word_t operand, const bool forWriteOnly)
 	{
 		int cycles=0;
 		
-		invalidate(EA);
+		invalidate(addr);
 		invalidate(M);
 
 		maddr8_t addr8;
 
-		switch (op.addrmode)
+		switch (adrmode)
 		{
 		case ADR_IMP: // Ignore. Address is implied in instruction.
 			break;
 
 		case ADR_ZP: // Zero Page mode. Use the address given after the opcode, but without high byte.
-			addr8=mmc::fetchByteOperand(PC);
+			addr8=maddr8_t(operand);
 			addr=addr8;
 			value=mmc::loadZPByte(addr8);
 			break;
 
 		case ADR_REL: // Relative mode.
-			addr=valueOf(mmc::fetchByteOperand(PC));
+			addr=operand;
 			if (addr[7])
 			{
 				// sign extension
 				addr|=maddr_t(0xFF00);
 			}
-			addr+=PC;
+			addr+=cpuState().PC;
 			break;
 
 		case ADR_ABS: // Absolute mode. Use the two bytes following the opcode as an address.
-			addr=mmc::fetchWordOperand(PC);
+			addr=operand;
 			if (!forWriteOnly) value=mmc::read(addr);
 			break;
 
 		case ADR_IMM: //Immediate mode. The value is given after the opcode.
-			addr=PC;
-			value=mmc::fetchByteOperand(PC);
+			addr=cpuState().PC.minus(1);
+			value=operand;
 			break;
 
 		case ADR_ZPX:
 			// Zero Page Indexed mode, X as index. Use the address given
 			// after the opcode, then add the
 			// X register to it to get the final address.
-			addr8=mmc::fetchByteOperand(PC).plus(X);
+			addr8=maddr8_t(operand).plus(cpuState().X);
 			addr=addr8;
 			value=mmc::loadZPByte(addr8);
 			break;
@@ -488,7 +556,7 @@ namespace cpu
 			// Zero Page Indexed mode, Y as index. Use the address given
 			// after the opcode, then add the
 			// Y register to it to get the final address.
-			addr8=mmc::fetchByteOperand(PC).plus(Y);
+			addr8=maddr8_t(operand).plus(cpuState().Y);
 			addr=addr8;
 			value=mmc::loadZPByte(addr8);
 			break;
@@ -496,53 +564,75 @@ namespace cpu
 		case ADR_ABSX:
 			// Absolute Indexed Mode, X as index. Same as zero page
 			// indexed, but with the high byte.
-			addr=mmc::fetchWordOperand(PC);
-			if ((valueOf(addr)&0xFF00)!=((valueOf(addr)+X)&0xFF00)) ++cycles;
-			addr+=X;
+			addr=operand;
+			if ((valueOf(addr)&0xFF00)!=((valueOf(addr)+cpuState().X)&0xFF00)) ++cycles;
+			addr+=cpuState().X;
 			if (!forWriteOnly) value=mmc::read(addr);
 			break;
 
 		case ADR_ABSY:
 			// Absolute Indexed Mode, Y as index. Same as zero page
 			// indexed, but with the high byte.
-			addr=mmc::fetchWordOperand(PC);
-			if ((valueOf(addr)&0xFF00)!=((valueOf(addr)+Y)&0xFF00)) ++cycles;
-			addr+=Y;
+			addr=operand;
+			if ((valueOf(addr)&0xFF00)!=((valueOf(addr)+cpuState().Y)&0xFF00)) ++cycles;
+			addr+=cpuState().Y;
 			if (!forWriteOnly) value=mmc::read(addr);
 			break;
 
 		case ADR_INDX:
-			addr8=mmc::fetchByteOperand(PC).plus(X);
+			addr8=maddr8_t(operand).plus(cpuState().X);
 			addr=mmc::loadZPWord(addr8);
 			if (!forWriteOnly) value=mmc::read(addr);
 			break;
 
 		case ADR_INDY:
-			addr=mmc::loadZPWord(mmc::fetchByteOperand(PC));
-			if ((valueOf(addr)&0xFF00)!=((valueOf(addr)+Y)&0xFF00)) ++cycles;
-			addr+=Y;
+			addr=mmc::loadZPWord(maddr8_t(operand));
+			if ((valueOf(addr)&0xFF00)!=((valueOf(addr)+cpuState().Y)&0xFF00)) ++cycles;
+			addr+=cpuState().Y;
 			if (!forWriteOnly) value=mmc::read(addr);
 			break;
 
 		case ADR_IND:
 			// Indirect Absolute mode. Find the 16-bit address contained
 			// at the given location.
-			addr=mmc::fetchWordOperand(PC);
+			addr=operand;
 			addr=makeWord(mmc::read(addr), mmc::read(maddr_t(((valueOf(addr)+1)&0x00FF)|(valueOf(addr)&0xFF00))));
 			if (!forWriteOnly) value=mmc::read(addr);
 			break;
 
 		default:
-			FATAL_ERROR(INVALID_INSTRUCTION, INVALID_ADDRESS_MODE, "opcode", code, "instruction", op.inst, "adrmode", op.addrmode);
+			FATAL_ERROR(INVALID_INSTRUCTION, INVALID_ADDRESS_MODE, "adrmode", adrmode);
 			break;
 		}
 
 		return cycles;
 	}
 
-	static bool execute(const M6502_OPCODE op, bool& writeBack, int& cycles)
+	// instructions that store their result back to the effective address
+	static FORCE_INLINE bool writesBack(const M6502_INST inst)
+	{
+		switch (inst)
+		{
+		case INS_INC:
+		case INS_DEC:
+		case INS_ASL:
+		case INS_LSR:
+		case INS_ROL:
+		case INS_ROR:
+		case INS_STA:
+		case INS_STX:
+		case INS_STY:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// instruction is a template argument, so the switch below is resolved at compile time
+	template <M6502_INST inst>
+	static FORCE_INLINE bool execute(int& cycles)
 	{
-		switch (op.inst)
+		switch (inst)
 		{
 		// arithmetic
 		case INS_ADC: // Add with carry.
@@ -556,13 +646,11 @@ namespace cpu
 		case INS_INC: // Increment memory by one
 			inc(M);
 			status::setNZ(M);
-			writeBack = true;
 			break;
 
 		case INS_DEC: // Decrement memory by one
 			dec(M);
 			status::setNZ(M);
-			writeBack = true;
 			break;
 
 		case INS_DEX: // Decrement index X by one
@@ -596,7 +684,6 @@ namespace cpu
 
 		case INS_ASL:
 			bitshift::ASL(M);
-			writeBack = true;
 			break;
 
 		case INS_EOR: // XOR Memory with accumulator, store in accumulator
@@ -605,7 +692,6 @@ namespace cpu
 
 		case INS_LSR: // Shift right one bit
 			bitshift::LSR(M);
-			writeBack = true;
 			break;
 
 		case INS_LSRA:
@@ -618,7 +704,6 @@ namespace cpu
 
 		case INS_ROL: // Rotate one bit left
 			bitshift::ROL(M);
-			writeBack = true;
 			break;
 
 		case INS_ROLA:
@@ -627,7 +712,6 @@ namespace cpu
 
 		case INS_ROR: // Rotate one bit right
 			bitshift::ROR(M);
-			writeBack = true;
 			break;
 
 		case INS_RORA:
@@ -636,102 +720,102 @@ namespace cpu
 
 		// branch
 		case INS_JMP: // Jump to new location
-			PC=addr;
+			cpuState().PC=addr;
 			break;
 
 		case INS_JSR: // Jump to new location, saving return address. Push return address on stack
-			dec(PC);
+			dec(cpuState().PC);
 			stack::pushPC();
-			PC=addr;
+			cpuState().PC=addr;
 			break;
 		
 		case INS_RTS: // Return from subroutine. Pull PC from stack.
-			PC=stack::popWord();
-			inc(PC);
+			cpuState().PC=stack::popWord();
+			inc(cpuState().PC);
 			break;
 
 		case INS_BCC: // Branch on carry clear
-			if (!P[F_CARRY])
+			if (!cpuState().P[F_CARRY])
 			{
 jBranch:
-				cycles+=((valueOf(PC)^valueOf(addr))&0xFF00)?2:1;
-				PC=addr;
+				cycles+=((valueOf(cpuState().PC)^valueOf(addr))&0xFF00)?2:1;
+				cpuState().PC=addr;
 			}
 			break;
 
 		case INS_BCS: // Branch on carry set
-			if (P[F_CARRY]) goto jBranch;else break;
+			if (cpuState().P[F_CARRY]) goto jBranch;else break;
 		case INS_BEQ: // Branch on zero
-			if (P[F_ZERO]) goto jBranch;else break;
+			if (status::zero()) goto jBranch;else break;
 		case INS_BMI: // Branch on negative result
-			if (P[F_SIGN]) goto jBranch;else break;
+			if (status::negative()) goto jBranch;else break;
 		case INS_BNE: // Branch on not zero
-			if (!P[F_ZERO]) goto jBranch;else break;
+			if (!status::zero()) goto jBranch;else break;
 		case INS_BPL: // Branch on positive result
-			if (!P[F_SIGN]) goto jBranch;else break;
+			if (!status::negative()) goto jBranch;else break;
 		case INS_BVC: // Branch on overflow clear
-			if (!P[F_OVERFLOW]) goto jBranch;else break;
+			if (!cpuState().P[F_OVERFLOW]) goto jBranch;else break;
 		case INS_BVS: // Branch on overflow set
-			if (P[F_OVERFLOW]) goto jBranch;else break;
+			if (cpuState().P[F_OVERFLOW]) goto jBranch;else break;
 
 		// interrupt
 		case INS_BRK: // Break
-			inc(PC);
+			inc(cpuState().PC);
 			interrupt::request(IRQTYPE::BRK);
 			break;
 
 		case INS_RTI: // Return from interrupt. Pull status and PC from stack.
-			P.asBitField()=stack::popByte();
-			P|=F_RESERVED;
-			PC=stack::popWord();
+			cpuState().P.asBitField()=stack::popByte();
+			cpuState().P|=F_RESERVED;
+			status::reload();
+			cpuState().PC=stack::popWord();
 			break;
 
 		// set/clear flag
 		case INS_CLC: // Clear carry flag
-			P.clear(F_CARRY);
+			cpuState().P.clear(F_CARRY);
 			break;
 		case INS_CLD: // Clear decimal flag
-			P.clear(F_DECIMAL);
+			cpuState().P.clear(F_DECIMAL);
 			break;
 		case INS_CLI: // Clear interrupt flag
-			P.clear(F_INTERRUPT_OFF);
+			cpuState().P.clear(F_INTERRUPT_OFF);
 			break;
 		case INS_CLV: // Clear overflow flag
-			P.clear(F_OVERFLOW);
+			cpuState().P.clear(F_OVERFLOW);
 			break;
 		case INS_SEC: // Set carry flag
-			P.set(F_CARRY);
+			cpuState().P.set(F_CARRY);
 			break;
 		case INS_SED: // Set decimal flag
-			P.set(F_DECIMAL);
+			cpuState().P.set(F_DECIMAL);
 			break;
 		case INS_SEI: // Set interrupt disable status
-			P.set(F_INTERRUPT_OFF);
+			cpuState().P.set(F_INTERRUPT_OFF);
 			break;
 
 		// compare
 		case INS_BIT:
-			status::setNV(M);
-			status::setZ(M&=A);
+			status::setBIT(value, cpuState().A);
 			break;
 
 		case INS_CMP: // Compare memory and accumulator
 		case INS_CPX: // Compare memory and index X
 		case INS_CPY: // Compare memory and index Y
-			switch (op.inst)
+			switch (inst)
 			{
 			case INS_CMP:
-				temp=A;break;
+				temp=cpuState().A;break;
 			case INS_CPX:
-				temp=X;break;
+				temp=cpuState().X;break;
 			case INS_CPY:
-				temp=Y;break;
+				temp=cpuState().Y;break;
 			default:
 				break;
 			}
 			temp=temp+0x100-value;
 			// if (temp>0xFF) [R]-[M]>=0 C=1;
-			P.change<F_CARRY>(SUM.overflow());
+			cpuState().P.change<F_CARRY>(SUM.overflow());
 			temp=(temp-0x100)&0xFF;
 			status::setNZ(SUM);
 			break;
@@ -739,32 +823,29 @@ jBranch:
 		// load/store
 		case INS_LDA: // Load accumulator with memory
 			status::setNZ(M);
-			A=value;
+			cpuState().A=value;
 			break;
 
 		case INS_LDX: // Load index X with memory
 			status::setNZ(M);
-			X=value;
+			cpuState().X=value;
 			break;
 
 		case INS_LDY: // Load index Y with memory
 			status::setNZ(M);
-			Y=value;
+			cpuState().Y=value;
 			break;
 
 		case INS_STA: // Store accumulator in memory
-			value = A;
-			writeBack = true;
+			value = cpuState().A;
 			break;
 
 		case INS_STX: // Store index X in memory
-			value = X;
-			writeBack = true;
+			value = cpuState().X;
 			break;
 
 		case INS_STY: // Store index Y in memory
-			value = Y;
-			writeBack = true;
+			value = cpuState().Y;
 			break;
 
 		// stack
@@ -773,41 +854,43 @@ jBranch:
 			break;
 
 		case INS_PHP: // Push processor status on stack
-			stack::pushReg(P);
+			status::flush();
+			stack::pushReg(cpuState().P);
 			break;
 
 		case INS_PLA: // Pull accumulator from stack
-			A=stack::popByte();
+			cpuState().A=stack::popByte();
 			status::setNZ(regA);
 			break;
 
 		case INS_PLP: // Pull processor status from stack
-			P.asBitField()=stack::popByte();
-			P|=F_RESERVED;
+			cpuState().P.asBitField()=stack::popByte();
+			cpuState().P|=F_RESERVED;
+			status::reload();
 			break;
 		
 		// transfer
 		case INS_TAX: // Transfer accumulator to index X
-			X=A;
+			cpuState().X=cpuState().A;
 			status::setNZ(regX);
 			break;
 		case INS_TAY: // Transfer accumulator to index Y
-			Y=A;
+			cpuState().Y=cpuState().A;
 			status::setNZ(regY);
 			break;
 		case INS_TSX: // Transfer stack pointer to index X
-			X=valueOf(SP);
+			cpuState().X=valueOf(cpuState().SP);
 			status::setNZ(regX);
 			break;
 		case INS_TXA: // Transfer index X to accumulator
-			A=X;
+			cpuState().A=cpuState().X;
 			status::setNZ(regA);
 			break;
 		case INS_TXS: // Transfer index X to stack pointer
-			SP=X;
+			cpuState().SP=cpuState().X;
 			break;
 		case INS_TYA: // Transfer index Y to accumulator
-			A=Y;
+			cpuState().A=cpuState().Y;
 			status::setNZ(regA);
 			break;
 
@@ -823,71 +906,560 @@ jBranch:
 		return true;
 	}
 
-	int nextInstruction()
+	// what the checked handlers stop at before running an instruction, see enableChecks():
+	// code outside prg-rom and save ram, operands fetched across $FFFF and zero page pointers read across $FF.
+	// the memory code wraps around like the hardware for the unchecked handlers.
+	template <M6502_ADDRMODE adrmode, int size>
+	static void check(const DECODEDOP& op)
 	{
-		int cycles = 0;
-		// handle interrupt request
-		interrupt::poll();
-
-		// step1: fetch instruction
-		if (PC.zero())
+		const maddr_t opaddr = cpuState().PC.minus(size);
+		FATAL_ERROR_UNLESS(valueOf(opaddr)>=0x6000, INVALID_MEMORY_ACCESS, MEMORY_NOT_EXECUTABLE, "PC", valueOf(opaddr));
+		WARN_IF(!MSB(opaddr), INVALID_MEMORY_ACCESS, MEMORY_NOT_EXECUTABLE, "PC", valueOf(opaddr));
+		FATAL_ERROR_IF(size==3 && opaddr.plus(1).reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
+		switch (adrmode)
 		{
-			// program terminates
-			assert(SP.reachMax());
-			return -1;
+		case ADR_INDX:
+			FATAL_ERROR_IF(maddr8_t(op.operand).plus(cpuState().X).reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
+			break;
+		case ADR_INDY:
+			FATAL_ERROR_IF(maddr8_t(op.operand).reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
+			break;
+		default:
+			break;
 		}
+	}
 
-#ifdef WANT_RUN_HIT
-		instructionHit[PC&0x7FFF]=true;
-#endif
-
-		const maddr_t opaddr = PC;
-		const opcode_t opcode = mmc::fetchOpcode(PC);
-
-		// step2: decode
-		const M6502_OPCODE op = opcode::decode(opcode);
-		ERROR_UNLESS(opcode::usual(opcode), INVALID_INSTRUCTION, INVALID_OPCODE, "opaddr", valueOf(opaddr), "opcode", opcode, "instruction", op.inst);
+	// one handler per opcode with addressing mode, operation and timing folded together.
+	// every opcode has an unchecked and a checked handler, the unchecked one has no trace of the checks.
+	template <opcode_t code, M6502_INST inst, M6502_ADDRMODE adrmode, int size, int cycles, bool checked>
+	static int opHandler(const DECODEDOP& op)
+	{
+		assert(op.opcode == code && op.size == size);
+		if (checked) check<adrmode, size>(op);
 
-		// step3: read effective address & operands
-		cycles += readEffectiveAddress(opcode, op, (op.inst==INS_STA || op.inst==INS_STX || op.inst==INS_STY));
-		assert((valueOf(PC)-valueOf(opaddr)) == op.size);
+		int extraCycles = readEffectiveAddress<adrmode>(op.operand, inst==INS_STA || inst==INS_STX || inst==INS_STY);
 
 #ifdef WANT_DISASSEMBLY
-		debug::printDisassembly(opaddr, opcode, X, Y, EA, M);
+		debug::printDisassembly(cpuState().PC.minus(size), code, cpuState().X, cpuState().Y, addr, M);
 #endif
 
-		// step4: execute
-		bool writeBack = false;
-		if (!execute(op, writeBack, cycles))
+		if (!execute<inst>(extraCycles))
 		{
 			// execution failed
-			FATAL_ERROR(INVALID_INSTRUCTION, INVALID_OPCODE, "opaddr", valueOf(opaddr), "opcode", opcode, "instruction", op.inst);
+			FATAL_ERROR(INVALID_INSTRUCTION, INVALID_OPCODE, "opcode", code, "instruction", inst);
 			return -1;
 		}
 
-		// step5: write back (when needed)
-		if (writeBack)
+		if (writesBack(inst))
 		{
 			assert(addr != 0xCCCC);
 			mmc::write(addr, value);
 		}
 
-		cycles += op.cycles;
+		STAT_ADD(numInstructionsPerOpcode[(int)inst], 1);
+		STAT_ADD(numInstructionsPerAdrMode[(int)adrmode], 1);
+		return cycles+extraCycles;
+	}
+
+	// opcodes that are not in the opcode list
+	static int unusualOpHandler(const DECODEDOP& op)
+	{
+		// operands are already skipped, treat as a nop
+		const maddr_t opaddr = cpuState().PC.minus(op.size);
+		const M6502_OPCODE info = opcode::decode(op.opcode);
+		ERROR(INVALID_INSTRUCTION, INVALID_OPCODE, "opaddr", valueOf(opaddr), "opcode", op.opcode, "instruction", info.inst);
+		return info.cycles;
+	}
+
+	typedef int (*OPHANDLER)(const DECODEDOP& op);
+	static OPHANDLER opHandlers[2][256]; // unchecked, checked
+	static uint8_t opSizes[256];
+
+	// instructions after which execution does not simply fall through
+	static bool opEndsBlock[256];
+
+	void init()
+	{
+		for (int i=0;i<256;i++)
+		{
+			const M6502_OPCODE op = opcode::decode(i);
+			opHandlers[0][i]=unusualOpHandler;
+			opHandlers[1][i]=unusualOpHandler;
+
+			// size of unusual opcodes follows from their addressing mode
+			switch (op.addrmode)
+			{
+			case ADR_IMP:
+				opSizes[i]=1;
+				break;
+			case ADR_ABS:
+			case ADR_ABSX:
+			case ADR_ABSY:
+			case ADR_IND:
+			case ADR_INDABSX:
+				opSizes[i]=3;
+				break;
+			default:
+				opSizes[i]=2;
+				break;
+			}
+
+			switch (op.inst)
+			{
+			case INS_JMP:
+			case INS_JSR:
+			case INS_RTS:
+			case INS_RTI:
+			case INS_BRK:
+			case INS_BCC:
+			case INS_BCS:
+			case INS_BEQ:
+			case INS_BMI:
+			case INS_BNE:
+			case INS_BPL:
+			case INS_BVC:
+			case INS_BVS:
+				opEndsBlock[i]=true;
+				break;
+			default:
+				opEndsBlock[i]=false;
+				break;
+			}
+		}
+
+		// instantiate handlers for all opcodes in the list
+#define OPCODE(inst, code, adrmode, size, cycles) \
+		opHandlers[0][code]=opHandler<code, inst, adrmode, size, cycles, false>; \
+		opHandlers[1][code]=opHandler<code, inst, adrmode, size, cycles, true>; \
+		opSizes[code]=size;
+#include "opcodelist.h"
+#undef OPCODE
+	}
+
+	// fetch an instruction along with its operand, pc is moved past it
+	static FORCE_INLINE void decode(maddr_t& pc, DECODEDOP& op)
+	{
+		op.opcode = mmc::fetchOpcode(pc);
+		op.handler = opHandlers[cpuState().checked][op.opcode];
+		op.size = opSizes[op.opcode];
+		switch (op.size)
+		{
+		case 1:
+			op.operand = 0;
+			break;
+		case 2:
+			op.operand = valueOf(mmc::fetchByteOperand(pc));
+			break;
+		default:
+			op.operand = valueOf(mmc::fetchWordOperand(pc));
+			break;
+		}
+	}
+
+	// prg-rom bank currently mapped at pc
+	static FORCE_INLINE int currentBank(const maddr_t pc)
+	{
+		switch ((valueOf(pc)>>13)&3)
+		{
+		case 0: return emu::active().mmc.p8;
+		case 1: return emu::active().mmc.pA;
+		case 2: return emu::active().mmc.pC;
+		default: return emu::active().mmc.pE;
+		}
+	}
+
+	// decode the basic block starting at pc, stopping at the first jump, a known instruction or the end of the bank
+	static void fillCodeCache(DECODEDOP* const page, const maddr_t start)
+	{
+		const unsigned base = valueOf(start)&0xE000;
+		unsigned offset = valueOf(start)&0x1FFF;
+		while (offset<0x2000 && !page[offset].handler)
+		{
+			const opcode_t opcode = emu::ram().data(base+offset);
+
+			// instructions running into the next bank depend on two mappings and are not cached
+			if (offset+opSizes[opcode]>0x2000) break;
+
+			maddr_t pc(base+offset);
+			decode(pc, page[offset]);
+			if (opEndsBlock[opcode]) break;
+			offset+=opSizes[opcode];
+		}
+	}
+
+	// page of the code cache for pc under the current bank mapping, -1 if there is none.
+	// every 8K window has pages of its own, what is decoded and compiled for one holds addresses inside it.
+	static FORCE_INLINE int cachePage(const maddr_t pc, const int pageCount)
+	{
+		const int bank = currentBank(pc);
+		if (bank<0 || bank>=pageCount/4) return -1;
+		return ((valueOf(pc)>>13)&3)*(pageCount/4)+bank;
+	}
+
+	// decoded instruction at pc under the current bank mapping, null if it can't be cached
+	static FORCE_INLINE const DECODEDOP* lookupCodeCache(const maddr_t pc)
+	{
+		// code in ram may be overwritten at any time, only prg-rom is cached
+		if (!MSB(pc)) return nullptr;
+
+		CODECACHE& cache = cpuState().codeCache;
+		if (cache.pages==nullptr)
+		{
+			cache.pageCount = 4*rom::count8KPRG();
+			cache.pages = new DECODEDOP*[cache.pageCount];
+			memset(cache.pages, 0, sizeof(DECODEDOP*)*cache.pageCount);
+		}
+
+		const int index = cachePage(pc, cache.pageCount);
+		if (index<0) return nullptr;
+
+		DECODEDOP*& page = cache.pages[index];
+		if (page==nullptr)
+		{
+			page = new DECODEDOP[0x2000];
+			memset(page, 0, sizeof(DECODEDOP)*0x2000);
+		}
+
+		const DECODEDOP* op = &page[valueOf(pc)&0x1FFF];
+		if (!op->handler)
+		{
+			fillCodeCache(page, pc);
+			if (!op->handler) return nullptr;
+		}
+		return op;
+	}
+
+	// drop all decoded instructions, must be called whenever the prg-rom changes
+	void flushCodeCache()
+	{
+		CODECACHE& cache = cpuState().codeCache;
+		for (int i=0;i<cache.pageCount;i++)
+		{
+			delete[] cache.pages[i];
+		}
+		delete[] cache.pages;
+		cache.pages = nullptr;
+		cache.pageCount = 0;
+
+		// compiled blocks refer to the decoded instructions
+		jit::release(cpuState().jit);
+		cpuState().lastLoop.head = nullptr;
+	}
+
+	static const uint8_t IDLE_UNMATCHED=0;
+	static const uint8_t IDLE_NONE=0xFF;
+	static const int MAX_IDLE_LOOP=4;
+
+	// true if the operand reads memory only the cpu itself could change
+	static bool readsConstant(const M6502_ADDRMODE mode, const word_t operand)
+	{
+		switch (mode)
+		{
+		case ADR_IMP:
+		case ADR_IMM:
+		case ADR_ZP:
+		case ADR_ZPX:
+		case ADR_ZPY:
+			return true;
+		case ADR_ABS:
+			return operand<0x2000 || operand>=0x6000;
+		case ADR_ABSX:
+		case ADR_ABSY:
+			return operand+0xFF<0x2000 || operand>=0x6000;
+		default:
+			return false;
+		}
+	}
+
+	// number of instructions of the loop starting at head if it is an idle one, IDLE_NONE otherwise.
+	// an idle loop only loads, compares and tests memory that stays the same until the next event, then jumps back to head,
+	// so from its second round on every round leaves the cpu in the same state. its first instruction may also
+	// read $2002 for a BPL, whose vblank flag only changes at events, or count rounds in ram when the loop never ends.
+	// what those leave in the registers changes with every round but is overwritten again by the next round's first instruction.
+	static uint8_t matchIdleLoop(const maddr_t head)
+	{
+		bool counting = false; // the first instruction counts rounds in ram
+		unsigned counter = 0; // its address
+		maddr_t pc = head;
+		for (int count=1;count<=MAX_IDLE_LOOP;count++)
+		{
+			// all of the loop has to be in the bank the result is cached for
+			const DECODEDOP* op = lookupCodeCache(pc);
+			if (op==nullptr || !opcode::usual(op->opcode) || ((valueOf(pc)^valueOf(head))&0xE000)) return IDLE_NONE;
+
+			const M6502_OPCODE info = opcode::decode(op->opcode);
+			const maddr_t next = pc.plus(op->size);
+			switch (info.inst)
+			{
+			case INS_JMP:
+				return (info.addrmode==ADR_ABS && op->operand==valueOf(head))?count:IDLE_NONE;
+			case INS_BCC:
+			case INS_BCS:
+			case INS_BEQ:
+			case INS_BMI:
+			case INS_BNE:
+			case INS_BPL:
+			case INS_BVC:
+			case INS_BVS:
+				// a counting loop would leave some time
+				if (counting) return IDLE_NONE;
+				return ((valueOf(next)+(int8_t)op->operand)&0xFFFF)==valueOf(head)?count:IDLE_NONE;
+			case INS_INC:
+			case INS_DEC:
+				if (count>1 || !(info.addrmode==ADR_ZP || (info.addrmode==ADR_ABS && op->operand<0x2000))) return IDLE_NONE;
+				counting = true;
+				counter = op->operand&0x7FF;
+				break;
+			case INS_LDA:
+			case INS_LDX:
+			case INS_LDY:
+			case INS_BIT:
+				if (info.addrmode==ADR_ABS && op->operand==0x2002)
+				{
+					const DECODEDOP* branch = lookupCodeCache(next);
+					if (count>1 || branch==nullptr || opcode::decode(branch->opcode).inst!=INS_BPL) return IDLE_NONE;
+					break;
+				}
+				// fall through
+			case INS_CMP:
+			case INS_CPX:
+			case INS_CPY:
+			case INS_AND:
+			case INS_NOP:
+				if (!readsConstant(info.addrmode, op->operand)) return IDLE_NONE;
+				if (counting)
+				{
+					// the counter must not be read after it has changed
+					if (info.addrmode!=ADR_IMP && info.addrmode!=ADR_IMM && info.addrmode!=ADR_ZP && info.addrmode!=ADR_ABS) return IDLE_NONE;
+					if (info.addrmode!=ADR_IMP && info.addrmode!=ADR_IMM && op->operand<0x2000 && (op->operand&0x7FF)==counter) return IDLE_NONE;
+				}
+				break;
+			default:
+				return IDLE_NONE;
+			}
+			pc = next;
+		}
+		return IDLE_NONE;
+	}
+
+	// execution has just jumped back to head. if that closed a round of an idle loop,
+	// runs through all the rounds that fit before the cpu runs out of cycles at once.
+	// the last round is left to run for real, the registers end up with what it reads.
+	static void skipIdleLoop(const maddr_t head)
+	{
+		if (cpuState().remainingCycles<=0 || interrupt::pending()) return;
+
+		const DECODEDOP* op = lookupCodeCache(head);
+		if (op==nullptr) return;
+		if (op->idleLoop==IDLE_UNMATCHED) op->idleLoop = matchIdleLoop(head);
+		if (op->idleLoop==IDLE_NONE) return;
+
+		// the round since the last visit ran through the loop alone
+		if (cpuState().lastLoop.head==op && cpuState().instructionCount-cpuState().lastLoop.instructionCount==op->idleLoop)
+		{
+			const long cycles = (long)(cpuState().cycleCount-cpuState().lastLoop.cycleCount);
+			const long rounds = (cpuState().remainingCycles-1)/cycles;
+			switch (opcode::decode(op->opcode).inst)
+			{
+			case INS_INC:
+				emu::ram().bank0[op->operand&0x7FF] += (uint8_t)rounds;
+				break;
+			case INS_DEC:
+				emu::ram().bank0[op->operand&0x7FF] -= (uint8_t)rounds;
+				break;
+			default:
+				break;
+			}
+			STAT_ADD(totInstructions, (long long)rounds*op->idleLoop);
+			STAT_ADD(totCycles, (long long)rounds*cycles);
+			cpuState().cycleCount += (long long)rounds*cycles;
+			cpuState().instructionCount += (long long)rounds*op->idleLoop;
+			cpuState().remainingCycles -= rounds*cycles;
+		}
+		cpuState().lastLoop.head = op;
+		cpuState().lastLoop.cycleCount = cpuState().cycleCount;
+		cpuState().lastLoop.instructionCount = cpuState().instructionCount;
+	}
+
+	void enableJIT(bool enabled)
+	{
+		cpuState().jit.enabled = enabled && jit::supported();
+	}
+
+	// run the checked handlers, e.g. to find out why a game went wrong without rebuilding.
+	// instructions decoded and compiled so far hold the other handlers, so they are dropped.
+	void enableChecks(bool enabled)
+	{
+		if (cpuState().checked==enabled) return;
+		cpuState().checked = enabled;
+		flushCodeCache();
+	}
+
+	int nextInstruction()
+	{
+		// handle interrupt request
+		interrupt::poll();
+
+		// step1: fetch instruction
+		if (cpuState().PC.zero())
+		{
+			// program terminates
+			assert(cpuState().SP.reachMax());
+			return -1;
+		}
+
+#ifdef WANT_RUN_HIT
+		instructionHit[cpuState().PC&0x7FFF]=true;
+#endif
+
+		const DECODEDOP* op = lookupCodeCache(cpuState().PC);
+		DECODEDOP uncached;
+		if (op!=nullptr)
+		{
+			cpuState().PC += op->size;
+		}
+		else
+		{
+			decode(cpuState().PC, uncached);
+			op = &uncached;
+		}
+
+		// step2: address, execute and write back in one go
+		const int cycles = op->handler(*op);
+		if (cycles<0) return -1;
 		// end of instruction pipeline
 
-		assert(P[F_RESERVED]);
+		assert(cpuState().P[F_RESERVED]);
 #ifdef MONITOR_CPU
-		debug::printCPUState(PC, A, X ,Y, valueOf(P), SP, cycles);
+		status::flush();
+		debug::printCPUState(cpuState().PC, cpuState().A, cpuState().X ,cpuState().Y, valueOf(cpuState().P), cpuState().SP, cycles);
 #endif
 
 		// update statistics
 		STAT_ADD(totInstructions, 1);
-		STAT_ADD(numInstructionsPerOpcode[(int)op.inst], 1);
-		STAT_ADD(numInstructionsPerAdrMode[(int)op.addrmode], 1);
 		STAT_ADD(totCycles, cycles);
-		remainingCycles -= cycles;
+		cpuState().cycleCount += cycles;
+		++cpuState().instructionCount;
+		cpuState().remainingCycles -= cycles;
 		return cycles;
 	}
+
+#ifdef WANT_JIT
+	// longest run of instructions compiled into one block
+	static const int MAX_BLOCK_SIZE=64;
+
+	// times the interpreter starts at an address before a block is compiled from there,
+	// code that only runs while loading or between levels isn't worth compiling
+	static const int HOT_BLOCK=64;
+
+	// mmc register holding the bank mapped at pc
+	static const int& bankRegister(const maddr_t pc)
+	{
+		switch ((valueOf(pc)>>13)&3)
+		{
+		case 0: return emu::active().mmc.p8;
+		case 1: return emu::active().mmc.pA;
+		case 2: return emu::active().mmc.pC;
+		default: return emu::active().mmc.pE;
+		}
+	}
+
+	// translate the decoded instructions from pc up to the end of their basic block, cached is their page of the code cache
+	static JITBLOCK compileBlock(const maddr_t pc, const int cached)
+	{
+		const DECODEDOP* const page = cpuState().codeCache.pages[cached];
+		const int bank = currentBank(pc);
+		const unsigned base = valueOf(pc)&0xE000;
+		unsigned offset = valueOf(pc)&0x1FFF;
+
+		JITOP ops[MAX_BLOCK_SIZE];
+		int count = 0;
+		while (count<MAX_BLOCK_SIZE && offset<0x2000 && page[offset].handler)
+		{
+			const DECODEDOP& op = page[offset];
+			ops[count].op = &op;
+			ops[count].nextPC = (base+offset+op.size)&0xFFFF;
+			ops[count].mayBankSwitch = writesBack(opcode::decode(op.opcode).inst);
+			++count;
+
+			if (opEndsBlock[op.opcode]) break;
+			offset += op.size;
+		}
+
+		JITSTATE& state = cpuState().jit;
+		JITBLOCK block = jit::compile(state, ops, count, bankRegister(pc), bank);
+		if (block==nullptr && state.enabled)
+		{
+			// code buffer is full at its largest size, start over
+			jit::reset(state);
+			block = jit::compile(state, ops, count, bankRegister(pc), bank);
+		}
+		return block;
+	}
+
+	// compiled block starting at pc under the current bank mapping, null if pc can't be run natively or isn't hot yet
+	static FORCE_INLINE JITBLOCK lookupBlock(const maddr_t pc)
+	{
+		JITSTATE& state = cpuState().jit;
+		const int cached = cachePage(pc, state.pageCount);
+		if (MSB(pc) && cached>=0 && state.pages[cached]!=nullptr)
+		{
+			JITENTRY& entry = state.pages[cached][valueOf(pc)&0x1FFF];
+			if (entry.block!=nullptr) return entry.block;
+			if (entry.visits==JIT_UNCOMPILABLE || ++entry.visits<HOT_BLOCK) return nullptr;
+		}
+
+		// makes sure the instructions are decoded
+		if (lookupCodeCache(pc)==nullptr)
+		{
+			if (MSB(pc) && cached>=0 && state.pages[cached]!=nullptr) state.pages[cached][valueOf(pc)&0x1FFF].visits = JIT_UNCOMPILABLE;
+			return nullptr;
+		}
+
+		if (state.pages==nullptr)
+		{
+			state.pageCount = cpuState().codeCache.pageCount;
+			state.pages = new JITENTRY*[state.pageCount];
+			memset(state.pages, 0, sizeof(JITENTRY*)*state.pageCount);
+		}
+
+		const int page = cachePage(pc, state.pageCount);
+		if (state.pages[page]==nullptr)
+		{
+			state.pages[page] = new JITENTRY[0x2000];
+			memset(state.pages[page], 0, sizeof(JITENTRY)*0x2000);
+		}
+
+		JITENTRY& entry = state.pages[page][valueOf(pc)&0x1FFF];
+		if (entry.visits<HOT_BLOCK) return nullptr;
+		entry.block = compileBlock(pc, page);
+		// left to the interpreter for good
+		if (entry.block==nullptr) entry.visits = JIT_UNCOMPILABLE;
+		return entry.block;
+	}
+
+	// same as run(-1, ...) but executes compiled blocks wherever the interpreter would have done nothing else
+	static bool runCompiled()
+	{
+		while (cpuState().remainingCycles>0)
+		{
+			JITBLOCK block = nullptr;
+			if (!interrupt::pending() && !cpuState().PC.zero())
+			{
+				block = lookupBlock(cpuState().PC);
+			}
+
+			if (block!=nullptr)
+			{
+				const maddr_t pc = cpuState().PC;
+				if (block()<0) return false; // execution terminated
+				if (cpuState().PC==pc) skipIdleLoop(cpuState().PC);
+			}
+			else if (nextInstruction()<0) return false;
+		}
+		return true;
+	}
+#endif
 }
 
 // unit tests
@@ -901,68 +1473,71 @@ public:
 
 	virtual TestResult run()
 	{
-		P.clearAll();
+		cpuState().P.clearAll();
 
-		A=0;
-		status::setZ(regA);
-		tassert(P[F_ZERO]);
+		cpuState().A=0;
+		status::setNZ(regA);
+		tassert(status::zero() && !status::negative());
 
-		X=0xFF;
+		cpuState().X=0xFF;
 		status::setNZ(regX);
-		tassert(!P[F_ZERO] && P[F_NEGATIVE]);
+		tassert(!status::zero() && status::negative());
 
 		value=0x10;
 		temp=value<<4;
-		P.change(F_CARRY,SUM.overflow());
-		tassert(P[F_CARRY]);
+		cpuState().P.change(F_CARRY,SUM.overflow());
+		tassert(cpuState().P[F_CARRY]);
 
-		M=F_NEGATIVE;
-		status::setNV(M);
-		tassert(P[F_NEGATIVE] && !P[F_OVERFLOW]);
+		status::setBIT(F_NEGATIVE, 0);
+		tassert(status::negative() && status::zero() && !cpuState().P[F_OVERFLOW]);
 
-		temp=0x100;
-		status::setNV(SUM);
-		tassert(!P[F_NEGATIVE] && !P[F_OVERFLOW]);
+		status::setBIT(F_OVERFLOW, F_OVERFLOW);
+		tassert(!status::negative() && !status::zero() && cpuState().P[F_OVERFLOW]);
 
-		P|=F_OVERFLOW;
-		tassert(P[F_OVERFLOW]);
+		// N and Z reach P through flush() and come back with reload()
+		status::flush();
+		tassert(!cpuState().P[F_NEGATIVE] && !cpuState().P[F_ZERO]);
+		cpuState().P|=F_NEGATIVE;
+		cpuState().P|=F_ZERO;
+		status::reload();
+		tassert(status::negative() && status::zero());
 
-		Y=0x80;
+		cpuState().Y=0x80;
 		bitshift::ASL(regY);
-		tassert(Y==0 && P[F_CARRY] && P[F_ZERO] && !P[F_NEGATIVE]);
+		tassert(cpuState().Y==0 && cpuState().P[F_CARRY] && status::zero() && !status::negative());
 
 		value=0x41;
 		bitshift::ASL(M);
-		tassert(!P[F_CARRY] && !P[F_ZERO] && P[F_NEGATIVE]);
+		tassert(!cpuState().P[F_CARRY] && !status::zero() && status::negative());
 
-		A=0x80;
+		cpuState().A=0x80;
 		bitshift::LSR(regA);
-		tassert(!P[F_CARRY] && !P[F_ZERO] && !P[F_NEGATIVE]);
+		tassert(!cpuState().P[F_CARRY] && !status::zero() && !status::negative());
 
 		value=0x01;
 		bitshift::LSR(M);
-		tassert(P[F_CARRY] && P[F_ZERO] && !P[F_NEGATIVE]);
+		tassert(cpuState().P[F_CARRY] && status::zero() && !status::negative());
 
-		X=0x40;
+		cpuState().X=0x40;
 		bitshift::ROR(regX);
-		tassert(X==0xA0);
-		tassert(!P[F_CARRY] && !P[F_ZERO] && P[F_NEGATIVE]);
+		tassert(cpuState().X==0xA0);
+		tassert(!cpuState().P[F_CARRY] && !status::zero() && status::negative());
 
-		Y=1;
+		cpuState().Y=1;
 		bitshift::ROR(regY);
-		tassert(P[F_ZERO] && P[F_CARRY] && !P[F_NEGATIVE]);
+		tassert(status::zero() && cpuState().P[F_CARRY] && !status::negative());
 
 		bitshift::ROL(regY);
-		tassert(Y==1 && !P[F_NEGATIVE] && !P[F_CARRY] && !P[F_ZERO]);
+		tassert(cpuState().Y==1 && !status::negative() && !cpuState().P[F_CARRY] && !status::zero());
 
-		P|=F_CARRY;
+		cpuState().P|=F_CARRY;
 		bitshift::ROL(regY);
-		tassert(Y==3);
+		tassert(cpuState().Y==3);
 
-		SP.selfSetMax();
+		cpuState().SP.selfSetMax();
 		stack::pushReg(regY);
 
-		PC=0xFFAA;
+		cpuState().PC=0xFFAA;
 		stack::pushPC();
 
 		byte_t tmp;
@@ -985,10 +1560,150 @@ public:
 		tmp=stack::popByte();
 		tassert(tmp==0xFF);
 
-		printf("[ ] Register memory from %p to %p\n", &A, &temp+1);
+		printf("[ ] Register memory from %p to %p\n", &cpuState().A, &temp+1);
+
+		return SUCCESS;
+	}
+};
+
+registerTestCase(CPUTest);
+class CodeCacheTest : public TestCase
+{
+public:
+	virtual const char* name()
+	{
+		return "Code Cache Unit Test";
+	}
+
+	virtual TestResult run()
+	{
+		// tests run before the emulator is initialized
+		emu::init();
+
+		emu::Machine* m=new emu::Machine();
+		{
+			emu::MachineScope scope(m);
+
+			// 16K cartridge looping over LDA #$01; INX; JMP $8000
+			static const uint8_t code[]={0xA9, 0x01, 0xE8, 0x4C, 0x00, 0x80};
+			loadTestProgram(*m, code, sizeof(code));
+
+			tassert(cpu::run(10, 1000)); // reset + 3 loops
+			tassert(cpuState().X==3 && cpuState().A==1);
+
+			// the loop is decoded once, up to the jump
+			const CODECACHE& cache=m->cpu.codeCache;
+			tassert(cache.pageCount==8 && cache.pages[0]!=nullptr);
+			for (int i=1;i<cache.pageCount;i++) tassert(cache.pages[i]==nullptr);
+			tassert(cache.pages[0][0].size==2 && cache.pages[0][0].operand==0x01);
+			tassert(cache.pages[0][3].operand==0x8000);
+			tassert(cache.pages[0][1].handler==nullptr && cache.pages[0][6].handler==nullptr);
+
+			// code in ram is never cached
+			emu::ram().bank0[0x0200]=0xE8; // INX
+			emu::ram().bank0[0x0201]=0x4C; // JMP $8000
+			emu::ram().bank0[0x0202]=0x00;
+			emu::ram().bank0[0x0203]=0x80;
+			cpuState().PC=0x0200;
+			tassert(cpu::run(2, 1000));
+			tassert(cpuState().X==4 && cpuState().PC==0x8000);
+
+			cpu::flushCodeCache();
+			tassert(cache.pages==nullptr);
+
+			// the checked handlers run the same loop the same way
+			tassert(cpu::run(3, 1000));
+			const cpu::OPHANDLER fast=cache.pages[0][0].handler;
+			cpu::enableChecks(true);
+			tassert(cache.pages==nullptr);
+			tassert(cpu::run(3, 1000));
+			tassert(cpuState().X==6 && cpuState().A==1 && cpuState().PC==0x8000);
+			tassert(cache.pages[0][0].handler!=fast && cache.pages[0][0].handler!=nullptr);
+			cpu::enableChecks(false);
+			tassert(cpu::run(3, 1000));
+			tassert(cpuState().X==7 && cache.pages[0][0].handler==fast);
+		}
+		delete m;
+		return SUCCESS;
+	}
+};
 
+registerTestCase(CodeCacheTest);
+class IdleLoopTest : public TestCase
+{
+public:
+	virtual const char* name()
+	{
+		return "Idle Loop Test";
+	}
+
+	// cpu state after running code at $8000 from reset
+	struct RESULT
+	{
+		int a, x, y, p, pc, counter;
+		long long cycles, instructions;
+		long remaining;
+		uint8_t match;
+	};
+
+	static RESULT runCode(const uint8_t* code, const size_t size, const bool fastForward, const bool jit)
+	{
+		RESULT r;
+		emu::Machine* m=new emu::Machine();
+		{
+			emu::MachineScope scope(m);
+			loadTestProgram(*m, code, size);
+			cpu::enableJIT(jit);
+
+			// idle loops are only skipped when running up to a number of cycles
+			for (int i=0;i<3;i++) cpu::run(fastForward?-1:0x7FFFFFFF, 10000);
+
+			status::flush();
+			r.a=cpuState().A; r.x=cpuState().X; r.y=cpuState().Y; r.p=valueOf(cpuState().P); r.pc=valueOf(cpuState().PC);
+			r.counter=m->ram.bank0[0];
+			r.cycles=cpuState().cycleCount;
+			r.instructions=cpuState().instructionCount;
+			r.remaining=cpuState().remainingCycles;
+			r.match=m->cpu.codeCache.pages[0][0].idleLoop;
+		}
+		delete m;
+		return r;
+	}
+
+	static bool sameResult(const uint8_t* code, const size_t size, const uint8_t match)
+	{
+		const RESULT stepped=runCode(code, size, false, false);
+		for (int jit=0;jit<2;jit++)
+		{
+			const RESULT r=runCode(code, size, true, jit!=0);
+			if (r.a!=stepped.a || r.x!=stepped.x || r.y!=stepped.y || r.p!=stepped.p || r.pc!=stepped.pc || r.counter!=stepped.counter) return false;
+			if (r.cycles!=stepped.cycles || r.instructions!=stepped.instructions || r.remaining!=stepped.remaining) return false;
+			if (r.match!=match) return false;
+		}
+		return true;
+	}
+
+	virtual TestResult run()
+	{
+		emu::init();
+
+		// LDA $10; BEQ $8000
+		static const uint8_t poll[]={0xA5, 0x10, 0xF0, 0xFC};
+		tassert(sameResult(poll, sizeof(poll), 2));
+		// BIT $2002; BPL $8000
+		static const uint8_t vblank[]={0x2C, 0x02, 0x20, 0x10, 0xFB};
+		tassert(sameResult(vblank, sizeof(vblank), 2));
+		// INC $00; JMP $8000
+		static const uint8_t count[]={0xE6, 0x00, 0x4C, 0x00, 0x80};
+		tassert(sameResult(count, sizeof(count), 2));
+		// INC $00; LDA $00; JMP $8000 reads what it counts
+		static const uint8_t readCount[]={0xE6, 0x00, 0xA5, 0x00, 0x4C, 0x00, 0x80};
+		tassert(sameResult(readCount, sizeof(readCount), cpu::IDLE_NONE));
+		// INC $00; BNE $8000 leaves after 256 rounds
+		static const uint8_t delay[]={0xE6, 0x00, 0xD0, 0xFC};
+		tassert(sameResult(delay, sizeof(delay), cpu::IDLE_NONE));
 		return SUCCESS;
 	}
 };
 
-registerTestCase(CPUTest);
\ No newline at end of file
+registerTestCase(IdleLoopTest);
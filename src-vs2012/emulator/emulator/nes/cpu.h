@@ -24,9 +24,93 @@ enum class IRQTYPE
 	RST=0x8
 };
 
+// instruction with its operand already fetched
+struct DECODEDOP
+{
+	int (*handler)(const DECODEDOP& op); // null while not decoded
+	word_t operand;
+	opcode_t opcode;
+	uint8_t size;
+	mutable uint8_t idleLoop; // instructions of the idle loop starting here, see matchIdleLoop()
+};
+
+// decoded instructions of the prg-rom, one page of 0x2000 entries per 8K bank and window it is mapped at
+// (a bank may be mapped twice, e.g. the 16K of NROM-128 at $8000 and $C000), see cpu::cachePage()
+struct CODECACHE
+{
+	DECODEDOP** pages; // allocated on demand
+	int pageCount;
+};
+
+// last round of an idle loop the cpu went through, to fast-forward the ones after it
+struct IDLELOOP
+{
+	const DECODEDOP* head; // null if none
+	long long cycleCount;
+	long long instructionCount;
+};
+
+// natively compiled run of instructions, returns -1 if an instruction failed
+typedef int (*JITBLOCK)();
+
+// where a block may start: compiled only once the interpreter has been there often enough
+struct JITENTRY
+{
+	JITBLOCK block; // null until compiled
+	int visits; // times the interpreter started here, JIT_UNCOMPILABLE once compiling failed
+};
+
+const int JIT_UNCOMPILABLE=-1;
+
+// state of the call-threading code generator, see jit.cpp
+struct JITSTATE
+{
+	bool enabled;
+
+	uint8_t* code; // code buffer, allocated with the first block
+	size_t codeSize;
+	size_t codeUsed;
+
+	JITENTRY** pages; // block entry points, laid out as the pages of the code cache
+	int pageCount;
+};
+
+struct SNAPSHOT;
+
+// register file and run-time state of the cpu
+struct CPUSTATE
+{
+	_reg8_t		A; // accumulator
+	_reg8_t		X, Y; // index
+	maddr8_t	SP; // stack pointer
+	flag_set<_reg8_t, PSW, 8> P; // status, N and Z only after status::flush()
+	word_t		nz; // last result setting N and Z, bit 8 forces N
+	maddr_t		PC; // program counter
+
+	maddr_t		addr; // effective address
+	byte_t		value; // operand
+	_alutemp_t	temp;
+
+	// interrupts
+	flag_set<_reg8_t, IRQTYPE, 8> pendingIRQs;
+
+	long		remainingCycles;
+
+	bool		checked; // instructions run through their checked handlers, see cpu::enableChecks()
+
+	// counters since last reset
+	long long	cycleCount;
+	long long	instructionCount;
+
+	CODECACHE	codeCache;
+	IDLELOOP	lastLoop;
+	JITSTATE	jit;
+};
+
 namespace cpu
 {
 	// global functions
+	void init();
 	void reset();
 
 	void irq(const IRQTYPE type);
@@ -34,10 +118,21 @@ namespace cpu
 	int nextInstruction();
 	bool run(int n, long cycles);
 
+	long long cycleCount();
+	long long instructionCount();
+
+	// cycles granted to run() so far, including the ones not yet run
+	long long cycleBudget();
+	void limitCycleBudget(const long long budget);
+
+	void flushCodeCache();
+	void enableJIT(bool enabled);
+	void enableChecks(bool enabled);
+
 	// debug
 	void dump();
 	
 	// save state
-	void save(FILE *fp);
-	void load(FILE *fp);
+	void save(SNAPSHOT& s);
+	void load(const SNAPSHOT& s);
 }
\ No newline at end of file
@@ -6,8 +6,12 @@
 
 #include "internals.h"
 #include "debug.h"
+#include "rom.h"
 #include "opcodes.h"
 #include "mmc.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "emu.h"
 
 static FILE* foutput = stdout;
 
@@ -22,10 +26,10 @@ namespace debug
 			fprintf(foutput, "%04X  %02X        %s", valueOf(pc), opcode, opcode::instName(op.inst));
 			break;
 		case 2:
-			fprintf(foutput, "%04X  %02X %02X     %s", valueOf(pc), opcode, ram.data(pc+1), opcode::instName(op.inst));
+			fprintf(foutput, "%04X  %02X %02X     %s", valueOf(pc), opcode, emu::ram().data(pc+1), opcode::instName(op.inst));
 			break;
 		case 3:
-			fprintf(foutput, "%04X  %02X %02X %02X  %s", valueOf(pc), opcode, ram.data(pc+1), ram.data(pc+2), opcode::instName(op.inst));
+			fprintf(foutput, "%04X  %02X %02X %02X  %s", valueOf(pc), opcode, emu::ram().data(pc+1), emu::ram().data(pc+2), opcode::instName(op.inst));
 			break;
 		}
 		switch (op.addrmode)
@@ -62,17 +66,17 @@ namespace debug
 
 	void printPPUState(const long long frameNum, const int scanline, const bool vblank, const bool hit, const bool bgmsk, const bool sprmsk)
 	{
-		fprintf(foutput, "----- FR: %I64d SL: %3d VB:%s HIT:%s MSK:%c%c -----\n", frameNum, scanline, vblank?"True":"false", hit?"Yes":"no", 
+		fprintf(foutput, "----- FR: %lld SL: %3d VB:%s HIT:%s MSK:%c%c -----\n", frameNum, scanline, vblank?"True":"false", hit?"Yes":"no", 
 			bgmsk?'B':'_', sprmsk?'S':'_');
 	}
 
 	// a NULL at the end of argv is REQUIRED!
-	static void printToConsole(int type, const wchar_t * typestr, int stype, const wchar_t * stypestr, const wchar_t * file, const wchar_t * function_name, unsigned long line_number, va_list argv)
+	static void printToConsole(int type, const char * typestr, int stype, const char * stypestr, const char * file, const char * function_name, unsigned long line_number, va_list argv)
 	{
-		wprintf(L"Type: %s (%d)\nSub Type: %s (%d)\nProc: %s:%ld\n", typestr, type, stypestr, stype, function_name, line_number);
+		printf("Type: %s (%d)\nSub Type: %s (%d)\nProc: %s:%ld\n", typestr, type, stypestr, stype, function_name, line_number);
 		if (file != nullptr)
 		{
-			wprintf(L"File: %s\n", file);
+			printf("File: %s\n", file);
 		}
 
 		// print custom parameters
@@ -84,7 +88,7 @@ namespace debug
 		}
 	}
 
-	static const wchar_t * errorTypeToString(EMUERROR type)
+	static const char * errorTypeToString(EMUERROR type)
 	{
 		switch (type)
 		{
@@ -93,11 +97,11 @@ namespace debug
 			CASE_ENUM_RETURN_STRING(INVALID_INSTRUCTION);
 			CASE_ENUM_RETURN_STRING(ILLEGAL_OPERATION);
 
-		default: return L"UNKNOWN";
+		default: return "UNKNOWN";
 		}
 	}
 
-	static const wchar_t * errorSTypeToString(EMUERRORSUBTYPE stype)
+	static const char * errorSTypeToString(EMUERRORSUBTYPE stype)
 	{
 		switch (stype)
 		{
@@ -113,21 +117,22 @@ namespace debug
 			CASE_ENUM_RETURN_STRING(MEMORY_CANT_BE_READ);
 			CASE_ENUM_RETURN_STRING(MEMORY_CANT_BE_WRITTEN);
 			CASE_ENUM_RETURN_STRING(MEMORY_CANT_BE_COPIED);
+			CASE_ENUM_RETURN_STRING(MEMORY_CANT_BE_ALLOCATED);
 
 			CASE_ENUM_RETURN_STRING(INVALID_OPCODE);
 			CASE_ENUM_RETURN_STRING(INVALID_ADDRESS_MODE);
 
 			CASE_ENUM_RETURN_STRING(IRQ_ALREADY_PENDING);
 
-		default: return L"UNKNOWN";
+		default: return "UNKNOWN";
 		}
 	}
 
-	void fatalError(EMUERROR type, EMUERRORSUBTYPE stype, const wchar_t * file, const wchar_t * function_name, unsigned long line_number, ...)
+	void fatalError(EMUERROR type, EMUERRORSUBTYPE stype, const char * file, const char * function_name, unsigned long line_number, ...)
 	{
 		va_list args;
 		va_start(args, line_number);
-		wprintf(L"[X] Fatal error: \n");
+		printf("[X] Fatal error: \n");
 		printToConsole(type, errorTypeToString(type), stype, errorSTypeToString(stype), file, function_name, line_number, args);
 		va_end(args);
 		fflush(foutput);
@@ -137,26 +142,26 @@ namespace debug
 		exit(type);
 	}
 
-	void error(EMUERROR type, EMUERRORSUBTYPE stype, const wchar_t * file, const wchar_t * function_name, unsigned long line_number, ...)
+	void error(EMUERROR type, EMUERRORSUBTYPE stype, const char * file, const char * function_name, unsigned long line_number, ...)
 	{
 		va_list args;
 		va_start(args, line_number);
-		wprintf(L"[X] Error: \n");
+		printf("[X] Error: \n");
 		printToConsole(type, errorTypeToString(type), stype, errorSTypeToString(stype), file, function_name, line_number, args);
 		va_end(args);
 		fflush(foutput);
 #ifndef NDEBUG
 		assert(0);
 #else
-		__debugbreak();
+		DEBUG_BREAK();
 #endif
 	}
 
-	void warn(EMUERROR type, EMUERRORSUBTYPE stype, const wchar_t * function_name, unsigned long line_number, ...)
+	void warn(EMUERROR type, EMUERRORSUBTYPE stype, const char * function_name, unsigned long line_number, ...)
 	{
 		va_list args;
 		va_start(args, line_number);
-		wprintf(L"[!] Warning: \n");
+		printf("[!] Warning: \n");
 		printToConsole(type, errorTypeToString(type), stype, errorSTypeToString(stype), NULL, function_name, line_number, args);
 		va_end(args);
 	}
@@ -13,28 +13,43 @@
 #include "cpu.h"
 #include "ppu.h"
 #include "emu.h"
+#include "rewind.h"
+#include "testrom.h"
 #include "../ui.h"
 
+#include <chrono>
+
 namespace emu
 {
-	void init()
+	// the machine behind the global functions
+	static Machine defaultMachine;
+
+	THREAD_LOCAL Machine* _active = &defaultMachine;
+
+	// all state starts out zero (no rom loaded, no code cached, interpreter only) before the reset
+	Machine::Machine():
+		cpu(), ram(), mmc(), mapper(), vram(), oam(), ppu(), render(), rom()
 	{
-		opcode::initTable();
-		ppu::init();
+		render.presentFrames=true;
+		reset();
 	}
 
-	void deinit()
+	Machine::~Machine()
 	{
+		MachineScope scope(this);
 		rom::unload();
 	}
 
-	bool load(const _TCHAR* file)
+	bool Machine::load(const _TCHAR* file)
 	{
+		MachineScope scope(this);
 		return rom::load(file);
 	}
 
-	void reset()
+	void Machine::reset()
 	{
+		MachineScope scope(this);
+
 		// reset mmc
 		mmc::reset();
 		mapper::reset();
@@ -46,18 +61,21 @@ namespace emu
 		ppu::reset();
 	}
 
-	bool setup()
+	bool Machine::setup()
 	{
+		MachineScope scope(this);
 		if (!mapper::setup()) return false;
 		if (!pmapper::setup()) return false;
 		return true;
 	}
 
-	bool nextFrame()
+	bool Machine::nextFrame()
 	{
+		MachineScope scope(this);
 		for (;;)
 		{
-			if (cpu::run(-1, SCANLINE_CYCLES))
+			// run the cpu through to the next scanline the ppu or the mapper has work at
+			if (cpu::run(-1, ppu::cyclesToNextEvent()))
 			{
 				if (!ppu::hsync())
 				{
@@ -71,8 +89,149 @@ namespace emu
 		return true;
 	}
 
+	// run as fast as possible without presenting frames or polling input.
+	// stops after maxFrames frames or maxSeconds seconds, whichever comes first (negative means no limit).
+	BATCHSTATS Machine::runBatch(long long maxFrames, double maxSeconds)
+	{
+		typedef std::chrono::steady_clock clock;
+
+		MachineScope scope(this);
+		BATCHSTATS stats;
+		memset(&stats, 0, sizeof(stats));
+
+		const long long cycles0=cpu::cycleCount();
+		const long long instructions0=cpu::instructionCount();
+		const clock::time_point start=clock::now();
+
+		render::enablePresent(false);
+		while (maxFrames<0 || stats.frames<maxFrames)
+		{
+			if (!nextFrame())
+			{
+				// game stops
+				break;
+			}
+			++stats.frames;
+			stats.seconds=std::chrono::duration<double>(clock::now()-start).count();
+			if (maxSeconds>=0 && stats.seconds>=maxSeconds) break;
+		}
+		render::enablePresent(true);
+
+		stats.seconds=std::chrono::duration<double>(clock::now()-start).count();
+		stats.cycles=cpu::cycleCount()-cycles0;
+		stats.instructions=cpu::instructionCount()-instructions0;
+		return stats;
+	}
+
+	// run hot code as compiled call chains where available instead of the interpreter, off for a new machine
+	void Machine::enableJIT(bool enabled)
+	{
+		MachineScope scope(this);
+		cpu::enableJIT(enabled);
+	}
+
+	// validate every instruction, at a cost only while enabled
+	void Machine::enableChecks(bool enabled)
+	{
+		MachineScope scope(this);
+		cpu::enableChecks(enabled);
+	}
+
+	// draw only every (frames+1)th frame, game logic runs the same either way
+	void Machine::setFrameSkip(int frames)
+	{
+		MachineScope scope(this);
+		render::setFrameSkip(frames);
+	}
+
+	long long Machine::frameCount()
+	{
+		MachineScope scope(this);
+		return ppu::currentFrame();
+	}
+
+	// copies the whole state into s, to be taken between frames
+	void Machine::snapshot(SNAPSHOT& s)
+	{
+		MachineScope scope(this);
+		STATIC_ASSERT(sizeof(CPUSNAPSHOT)==32 && sizeof(PPUSNAPSHOT)==72 && sizeof(MAPPERSNAPSHOT)==40);
+		STATIC_ASSERT(sizeof(SNAPSHOT)==176+0x800+0x2000+0x4000+0x100);
+		s.version=SNAPSHOT_VERSION;
+		s.size=sizeof(SNAPSHOT);
+		mmc::save(s);
+		cpu::save(s);
+		ppu::save(s);
+		mapper::save(s);
+		s.mirroring=(uint8_t)rom.mirroring;
+		memset(s.reserved, 0, sizeof(s.reserved));
+	}
+
+	// puts the machine back to a snapshot of the same rom, false if it's from another build
+	bool Machine::restore(const SNAPSHOT& s)
+	{
+		if (s.version!=SNAPSHOT_VERSION || s.size!=sizeof(SNAPSHOT)) return false;
+
+		MachineScope scope(this);
+		mmc::load(s);
+		cpu::load(s);
+		ppu::load(s);
+		mapper::load(s);
+		rom.mirroring=(MIRRORING)s.mirroring;
+		return true;
+	}
+
+	// a state file holds a single snapshot
+	void Machine::saveState(FILE *fp)
+	{
+		SNAPSHOT* s=new SNAPSHOT();
+		snapshot(*s);
+		fwrite(s, sizeof(SNAPSHOT), 1, fp);
+		delete s;
+	}
+
+	bool Machine::loadState(FILE *fp)
+	{
+		SNAPSHOT* s=new SNAPSHOT();
+		const bool loaded=fread(s, sizeof(SNAPSHOT), 1, fp)==1 && restore(*s);
+		delete s;
+		return loaded;
+	}
+
+	void init()
+	{
+		cpu::init();
+		ppu::init();
+	}
+
+	void deinit()
+	{
+		MachineScope scope(&defaultMachine);
+		rom::unload();
+	}
+
+	bool load(const _TCHAR* file)
+	{
+		return defaultMachine.load(file);
+	}
+
+	void reset()
+	{
+		defaultMachine.reset();
+	}
+
+	bool setup()
+	{
+		return defaultMachine.setup();
+	}
+
+	bool nextFrame()
+	{
+		return defaultMachine.nextFrame();
+	}
+
 	void run()
 	{
+		RewindBuffer history(REWIND_CAPACITY, REWIND_INTERVAL);
 		for (;;)
 		{
 			ui::doEvents();
@@ -82,18 +241,46 @@ namespace emu
 				cpu::dump();
 				break;
 			}
-			if (!nextFrame())
+			if (ui::rewindRequired())
 			{
-				// game stops
-				break;
+				// go back a snapshot and show the frame after it, which isn't recorded
+				if (history.stepBack(defaultMachine)) nextFrame();
+			}else
+			{
+				if (!nextFrame())
+				{
+					// game stops
+					break;
+				}
+				history.capture(defaultMachine);
 			}
 			ui::limitFPS();
 		}
 	}
 
+	BATCHSTATS runBatch(long long maxFrames, double maxSeconds)
+	{
+		return defaultMachine.runBatch(maxFrames, maxSeconds);
+	}
+
+	void enableJIT(bool enabled)
+	{
+		defaultMachine.enableJIT(enabled);
+	}
+
+	void enableChecks(bool enabled)
+	{
+		defaultMachine.enableChecks(enabled);
+	}
+
+	void setFrameSkip(int frames)
+	{
+		defaultMachine.setFrameSkip(frames);
+	}
+
 	long long frameCount()
 	{
-		return ppu::currentFrame();
+		return defaultMachine.frameCount();
 	}
 
 	void present(const uint32_t buffer[], const int width, const int height)
@@ -111,21 +298,147 @@ namespace emu
 		ui::onFrameEnd();
 	}
 
-	void saveState(FILE *fp)
+	void snapshot(SNAPSHOT& s)
+	{
+		defaultMachine.snapshot(s);
+	}
+
+	bool restore(const SNAPSHOT& s)
 	{
-		mmc::save(fp);
-		cpu::save(fp);
-		ppu::save(fp);
-		mapper::save(fp);
+		return defaultMachine.restore(s);
 	}
 
-	void loadState(FILE *fp)
+	void saveState(FILE *fp)
 	{
-		reset(); // necessary
+		defaultMachine.saveState(fp);
+	}
 
-		mmc::load(fp);
-		cpu::load(fp);
-		ppu::load(fp);
-		mapper::load(fp);
+	bool loadState(FILE *fp)
+	{
+		return defaultMachine.loadState(fp);
 	}
 }
+
+// unit tests
+class MachineTest : public TestCase
+{
+public:
+	virtual const char* name()
+	{
+		return "Machine Unit Test";
+	}
+
+	virtual TestResult run()
+	{
+		emu::Machine* m1=new emu::Machine();
+		emu::Machine* m2=new emu::Machine();
+		{
+			emu::MachineScope scope1(m1);
+			tassert(&emu::active()==m1);
+			mmc::write(maddr_t(0x0010), 0x12);
+			{
+				emu::MachineScope scope2(m2);
+				tassert(&emu::active()==m2);
+				tassert(mmc::read(maddr_t(0x0010))==0);
+				mmc::write(maddr_t(0x0010), 0x34);
+				tassert(mmc::read(maddr_t(0x0810))==0x34);
+			}
+			tassert(&emu::active()==m1);
+			tassert(mmc::read(maddr_t(0x0010))==0x12);
+		}
+		delete m2;
+		delete m1;
+		return SUCCESS;
+	}
+};
+
+registerTestCase(MachineTest);
+
+class SnapshotTest : public TestCase
+{
+public:
+	virtual const char* name()
+	{
+		return "Snapshot Unit Test";
+	}
+
+	// 16K cartridge counting in ram with rendering and the nmi on
+	static emu::Machine* createMachine()
+	{
+		// $8000: LDA #$80; STA $2000; LDA #$18; STA $2001
+		// $800A: INC $10; INX; STX $0300; JMP $800A
+		// $8013: NOPs
+		// $8020: INC $11; RTI (nmi)
+		static const uint8_t code[]={
+			0xA9, 0x80, 0x8D, 0x00, 0x20, 0xA9, 0x18, 0x8D, 0x01, 0x20,
+			0xE6, 0x10, 0xE8, 0x8E, 0x00, 0x03, 0x4C, 0x0A, 0x80,
+			0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA,
+			0xE6, 0x11, 0x40
+		};
+		emu::Machine* m=new emu::Machine();
+		loadTestProgram(*m, code, sizeof(code), 0x8020);
+		return m;
+	}
+
+	// runs both machines a few more frames, then compares where they got to
+	static bool sameRun(emu::Machine* m, emu::Machine* ref)
+	{
+		for (int i=0;i<5;i++)
+		{
+			if (!m->nextFrame() || !ref->nextFrame()) return false;
+		}
+		return m->cpu.X==ref->cpu.X && m->cpu.PC==ref->cpu.PC &&
+			m->cpu.cycleCount==ref->cpu.cycleCount && m->frameCount()==ref->frameCount() &&
+			memcmp(m->ram.bank0, ref->ram.bank0, sizeof(m->ram.bank0))==0 &&
+			memcmp(m->render.vBuffer, ref->render.vBuffer, sizeof(m->render.vBuffer))==0;
+	}
+
+	virtual TestResult run()
+	{
+		// tests run before the emulator is initialized
+		emu::init();
+
+		emu::Machine* m=createMachine();
+		emu::Machine* ref=createMachine();
+		SNAPSHOT* s=new SNAPSHOT();
+		for (int i=0;i<3;i++)
+		{
+			tassert(m->nextFrame() && ref->nextFrame());
+		}
+		// going back replays the same frames
+		m->snapshot(*s);
+		tassert(s->cpuRam[0x11]>0); // nmis are taken
+		tassert(s->version==SNAPSHOT_VERSION && s->size==sizeof(SNAPSHOT));
+		tassert(sameRun(m, ref));
+		tassert(m->restore(*s));
+		tassert(m->frameCount()==3);
+		ref->restore(*s);
+		tassert(sameRun(m, ref));
+
+		// into another machine with the same rom
+		emu::Machine* other=createMachine();
+		tassert(other->restore(*s));
+
+		// the same state gives the same bytes on any machine
+		SNAPSHOT* copy=new SNAPSHOT();
+		memset(copy, 0xCC, sizeof(SNAPSHOT));
+		other->snapshot(*copy);
+		tassert(memcmp(copy, s, sizeof(SNAPSHOT))==0);
+		delete copy;
+
+		ref->restore(*s);
+		tassert(sameRun(other, ref));
+		delete other;
+
+		// snapshots of other layouts are refused
+		s->version++;
+		tassert(!m->restore(*s));
+
+		delete s;
+		delete ref;
+		delete m;
+		return SUCCESS;
+	}
+};
+
+registerTestCase(SnapshotTest);
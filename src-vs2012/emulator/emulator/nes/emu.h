@@ -1,6 +1,157 @@
+// throughput of a batch run
+struct BATCHSTATS
+{
+	long long frames;
+	long long cycles; // cpu cycles
+	long long instructions;
+	double seconds; // wall-clock time
+};
+
+// layout version of SNAPSHOT, to be raised whenever its contents change
+const uint32_t SNAPSHOT_VERSION=2;
+
+// cpu registers and counters as saved
+struct CPUSNAPSHOT
+{
+	int64_t cycleCount;
+	int64_t instructionCount;
+	int64_t remainingCycles;
+	uint16_t PC;
+	uint8_t A, X, Y, SP;
+	uint8_t P; // N and Z included
+	uint8_t pendingIRQs;
+};
+
+// ppu registers and counters as saved
+struct PPUSNAPSHOT
+{
+	int64_t frameNum;
+	int64_t lineStart;
+	int32_t scanline;
+	int32_t chrBanks[8]; // 1K CHR-ROM bank of each pattern table page, -1 where vram is mapped
+	uint32_t latch; // wide enough for INVALID
+	uint16_t scroll, address, tmpAddress;
+	uint8_t control, mask, status, oamAddr;
+	uint8_t xoffset;
+	uint8_t firstWrite;
+	uint8_t reserved[4]; // zero
+};
+
+// mmc1 and mmc3 registers as saved, wide enough for INVALID
+struct MAPPERSNAPSHOT
+{
+	uint32_t mmc1Sel, mmc1Pos, mmc1Tmp;
+	uint32_t mmc3Control, mmc3Cmd, mmc3Data, mmc3Counter, mmc3Latch;
+	uint8_t mmc1Regs[4];
+	uint8_t mmc3IRQ;
+	uint8_t reserved[3]; // zero
+};
+
+// state of a machine between frames in one block of fixed size and layout, see Machine::snapshot().
+// only registers, counters, bank numbers and memory are kept, in fields of fixed width without padding,
+// so equal states give equal bytes. caches and host pointers are rebuilt for the machine it goes to.
+struct SNAPSHOT
+{
+	uint32_t version; // SNAPSHOT_VERSION
+	uint32_t size; // sizeof(SNAPSHOT)
+
+	CPUSNAPSHOT cpu;
+	PPUSNAPSHOT ppu;
+	MAPPERSNAPSHOT mapper;
+
+	// bank-switching state
+	int32_t prgBanks[4];
+	uint8_t saveRamEnabled;
+	uint8_t mirroring;
+	uint8_t reserved[6]; // zero
+
+	// memory, prg-rom and chr-rom stay in the rom image
+	uint8_t cpuRam[0x800];
+	uint8_t saveRam[0x2000];
+	uint8_t ppuRam[0x4000];
+	uint8_t spriteRam[0x100];
+};
+
 namespace emu
 {
-	// global functions
+	// a complete console. the core always emulates the machine that is active on the calling thread.
+	class Machine
+	{
+	public:
+		Machine();
+		~Machine();
+
+		bool load(const _TCHAR* file);
+		void reset();
+		bool setup();
+
+		bool nextFrame();
+		BATCHSTATS runBatch(long long maxFrames, double maxSeconds);
+		void enableJIT(bool enabled);
+		void enableChecks(bool enabled);
+		void setFrameSkip(int frames);
+
+		long long frameCount();
+
+		// save state
+		void snapshot(SNAPSHOT& s);
+		bool restore(const SNAPSHOT& s);
+		void saveState(FILE *fp);
+		bool loadState(FILE *fp);
+
+	public:
+		// hardware state
+		CPUSTATE cpu;
+		NESRAM ram;
+		MMCSTATE mmc;
+		MAPPERSTATE mapper;
+		NESVRAM vram;
+		NESOAM oam;
+		PPUSTATE ppu;
+		RENDERSTATE render;
+		ROMSTATE rom;
+
+	private:
+		Machine(const Machine&);
+		Machine& operator =(const Machine&);
+	};
+
+	// machine being emulated by the calling thread
+	extern THREAD_LOCAL Machine* _active;
+
+	inline Machine& active()
+	{
+		return *_active;
+	}
+
+	// memory of the active machine
+	inline NESRAM& ram()
+	{
+		return active().ram;
+	}
+
+	inline NESVRAM& vram()
+	{
+		return active().vram;
+	}
+
+	inline NESOAM& oam()
+	{
+		return active().oam;
+	}
+
+	// activates a machine on the calling thread until going out of scope
+	class MachineScope
+	{
+	public:
+		explicit MachineScope(Machine* machine): _prev(_active) {_active=machine;}
+		~MachineScope() {_active=_prev;}
+
+	private:
+		Machine* _prev;
+	};
+
+	// global functions (operate on the default machine)
 	void init();
 	void deinit();
 
@@ -10,15 +161,21 @@ namespace emu
 
 	bool nextFrame();
 	void run();
+	BATCHSTATS runBatch(long long maxFrames, double maxSeconds);
+	void enableJIT(bool enabled);
+	void enableChecks(bool enabled);
+	void setFrameSkip(int frames);
 
 	long long frameCount();
-	
+
 	// proxy functions
 	void present(const uint32_t buffer[], const int width, const int height);
 	void onFrameBegin();
 	void onFrameEnd();
 
 	// save state
+	void snapshot(SNAPSHOT& s);
+	bool restore(const SNAPSHOT& s);
 	void saveState(FILE *fp);
-	void loadState(FILE *fp);
-}
\ No newline at end of file
+	bool loadState(FILE *fp);
+}
@@ -64,6 +64,11 @@ inline rgb32_t Rgb32(const byte_t r,const byte_t g,const byte_t b)
     return b|(g<<8)|(r<<16);
 }
 
+inline rgb16_t Rgb16(const rgb32_t rgb)
+{
+    return (rgb16_t)(((rgb>>3)&0x1F)|((rgb>>5)&0x7E0)|((rgb>>8)&0xF800));
+}
+
 // hardware configuration
 #ifndef LEFT_CLIP
 	const int SCREEN_WIDTH=256;
@@ -105,6 +110,7 @@ enum EMUERRORSUBTYPE {
 	MEMORY_CANT_BE_READ,
 	MEMORY_CANT_BE_WRITTEN,
 	MEMORY_CANT_BE_COPIED,
+	MEMORY_CANT_BE_ALLOCATED,
 
 	// INVALID_INSTRUCTION
 	INVALID_OPCODE,
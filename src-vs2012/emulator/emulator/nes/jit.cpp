@@ -0,0 +1,435 @@
+#include "../stdafx.h"
+
+// executable memory
+#ifdef WANT_JIT
+	#ifdef _WIN32
+		// keep out the ERROR/min/max macros that clash with ours
+		#define WIN32_LEAN_AND_MEAN
+		#define NOGDI
+		#define NOMINMAX
+		#include <windows.h>
+	#else
+		#include <sys/mman.h>
+	#endif
+#endif
+
+// local header files
+#include "../macros.h"
+#include "../types/types.h"
+#include "../unittest/framework.h"
+
+#include "internals.h"
+#include "debug.h"
+#include "rom.h"
+#include "opcodes.h"
+#include "mmc.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "emu.h"
+#include "jit.h"
+#include "testrom.h"
+
+#if defined(WANT_JIT) && (defined(_M_X64) || defined(__x86_64__))
+	#define JIT_X64
+#endif
+
+// Call threading: blocks are compiled to a chain of direct calls into the interpreter's opcode handlers.
+// Instruction semantics and memory accesses therefore stay exactly those of the interpreter,
+// the native code only replaces dispatch and bookkeeping:
+//
+//	[if not first: leave when remainingCycles<=0 or an interrupt is pending]
+//	PC = next instruction
+//	eax = handler(op)
+//	leave with -1 when eax<0
+//	cycleCount += eax; ++instructionCount; remainingCycles -= eax
+//	[after memory writes: leave when the bank of this block has been switched out]
+namespace jit
+{
+#ifdef JIT_X64
+	// code buffer per machine, mapped with the first block and doubled each time it runs full up to its largest size
+	static const size_t MIN_CODE_SIZE=64*1024;
+	static const size_t MAX_CODE_SIZE=4*1024*1024;
+
+	// upper bound of the code generated for a single instruction
+	static const size_t MAX_OP_CODE=128;
+
+	// prologue and epilogue
+	static const size_t MAX_FRAME_CODE=64;
+
+	static const int MAX_EXITS=4*64;
+
+	// x86-64 encodings
+	enum
+	{
+		JNE=0x85,
+		JS=0x88,
+		JLE=0x8E
+	};
+
+	// the buffer is never writable and executable at once: it is mapped writable,
+	// and switched to executable after each block has been emitted and back while the next one is
+	static uint8_t* allocCode(const size_t size)
+	{
+#ifdef _WIN32
+		return (uint8_t*)VirtualAlloc(nullptr, size, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+#else
+		void* mem=mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		return mem==MAP_FAILED?nullptr:(uint8_t*)mem;
+#endif
+	}
+
+	static bool protectCode(uint8_t* mem, const size_t size, const bool executable)
+	{
+#ifdef _WIN32
+		DWORD previous;
+		if (!VirtualProtect(mem, size, executable?PAGE_EXECUTE_READ:PAGE_READWRITE, &previous)) return false;
+		if (executable) FlushInstructionCache(GetCurrentProcess(), mem, size);
+		return true;
+#else
+		return mprotect(mem, size, executable?(PROT_READ|PROT_EXEC):(PROT_READ|PROT_WRITE))==0;
+#endif
+	}
+
+	static void freeCode(uint8_t* mem, const size_t size)
+	{
+#ifdef _WIN32
+		VirtualFree(mem, 0, MEM_RELEASE);
+#else
+		munmap(mem, size);
+#endif
+	}
+
+	static inline void emit8(uint8_t*& p, const uint8_t byte)
+	{
+		*p++=byte;
+	}
+
+	static inline void emit32(uint8_t*& p, const uint32_t dword)
+	{
+		memcpy(p, &dword, 4);
+		p+=4;
+	}
+
+	static inline void emit64(uint8_t*& p, const uint64_t qword)
+	{
+		memcpy(p, &qword, 8);
+		p+=8;
+	}
+
+	// rbx holds the active machine, fields are addressed as [rbx+disp32]
+	static inline void emitField(uint8_t*& p, const uint8_t reg, const void* field)
+	{
+		const long long disp=(const uint8_t*)field-(const uint8_t*)&emu::active();
+		assert(disp>=0 && disp<0x7FFFFFFF);
+		emit8(p, 0x83|(reg<<3)); // mod=10 rm=rbx
+		emit32(p, (uint32_t)disp);
+	}
+
+	// cmp [field], 0
+	static void emitCmpZero(uint8_t*& p, const void* field, const size_t size)
+	{
+		switch (size)
+		{
+		case 1: emit8(p, 0x80); break;
+		case 2: emit8(p, 0x66); emit8(p, 0x83); break;
+		case 4: emit8(p, 0x83); break;
+		default: emit8(p, 0x48); emit8(p, 0x83); break;
+		}
+		emitField(p, 7, field);
+		emit8(p, 0);
+	}
+
+	// jcc rel32, returns the location of the displacement to be patched
+	static uint8_t* emitJcc(uint8_t*& p, const uint8_t cc)
+	{
+		emit8(p, 0x0F);
+		emit8(p, cc);
+		uint8_t* rel=p;
+		emit32(p, 0);
+		return rel;
+	}
+
+	static void patch(uint8_t* rel, const uint8_t* target)
+	{
+		const int32_t disp=(int32_t)(target-(rel+4));
+		memcpy(rel, &disp, 4);
+	}
+
+	bool supported()
+	{
+		return true;
+	}
+
+	JITBLOCK compile(JITSTATE& state, const JITOP ops[], const int count, const int& bankReg, const int bank)
+	{
+		vassert(count>0 && count*3<=MAX_EXITS);
+
+		const size_t needed=count*MAX_OP_CODE+MAX_FRAME_CODE;
+		if (state.code==nullptr || state.codeUsed+needed>state.codeSize)
+		{
+			if (state.code!=nullptr && state.codeSize>=MAX_CODE_SIZE) return nullptr;
+
+			// a bigger buffer, the blocks in the old one are dropped
+			const size_t size=(state.code==nullptr)?MIN_CODE_SIZE:state.codeSize*2;
+			reset(state);
+			if (state.code!=nullptr) freeCode(state.code, state.codeSize);
+			state.code=allocCode(size);
+			state.codeSize=(state.code==nullptr)?0:size;
+			if (state.code==nullptr)
+			{
+				ERROR(INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_ALLOCATED);
+				state.enabled=false;
+				return nullptr;
+			}
+		}
+		else if (!protectCode(state.code, state.codeSize, false))
+		{
+			ERROR(INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_ALLOCATED);
+			state.enabled=false;
+			return nullptr;
+		}
+
+		CPUSTATE& cpu=emu::active().cpu;
+		uint8_t* const start=state.code+state.codeUsed;
+		uint8_t* p=start;
+
+		uint8_t* exits[MAX_EXITS];
+		int exitCount=0;
+		uint8_t* errors[MAX_EXITS];
+		int errorCount=0;
+
+		// push rbx; sub rsp, 32 (keeps the stack aligned and reserves the win64 shadow space)
+		emit8(p, 0x53);
+		emit8(p, 0x48); emit8(p, 0x83); emit8(p, 0xEC); emit8(p, 0x20);
+		// mov rbx, machine
+		emit8(p, 0x48); emit8(p, 0xBB); emit64(p, (uint64_t)&emu::active());
+
+		for (int i=0;i<count;i++)
+		{
+			const JITOP& op=ops[i];
+
+			if (i>0)
+			{
+				// the run loop and interrupt::poll() get their turn between instructions
+				emitCmpZero(p, &cpu.remainingCycles, sizeof(cpu.remainingCycles));
+				exits[exitCount++]=emitJcc(p, JLE);
+				emitCmpZero(p, &cpu.pendingIRQs, sizeof(cpu.pendingIRQs));
+				exits[exitCount++]=emitJcc(p, JNE);
+			}
+
+			// mov [PC], nextPC
+			if (sizeof(cpu.PC)==2)
+			{
+				emit8(p, 0x66); emit8(p, 0xC7); emitField(p, 0, &cpu.PC);
+				emit8(p, (uint8_t)op.nextPC); emit8(p, (uint8_t)(op.nextPC>>8));
+			}
+			else
+			{
+				STATIC_ASSERT(sizeof(cpu.PC)==2 || sizeof(cpu.PC)==4);
+				emit8(p, 0xC7); emitField(p, 0, &cpu.PC);
+				emit32(p, op.nextPC);
+			}
+
+			// mov rcx/rdi, op; mov rax, handler; call rax
+#ifdef _WIN32
+			emit8(p, 0x48); emit8(p, 0xB9);
+#else
+			emit8(p, 0x48); emit8(p, 0xBF);
+#endif
+			emit64(p, (uint64_t)op.op);
+			emit8(p, 0x48); emit8(p, 0xB8); emit64(p, (uint64_t)op.op->handler);
+			emit8(p, 0xFF); emit8(p, 0xD0);
+
+			// test eax, eax; js fail
+			emit8(p, 0x85); emit8(p, 0xC0);
+			errors[errorCount++]=emitJcc(p, JS);
+
+			// movsxd rax, eax
+			emit8(p, 0x48); emit8(p, 0x63); emit8(p, 0xC0);
+
+			// add [cycleCount], rax
+			STATIC_ASSERT(sizeof(cpu.cycleCount)==8 && sizeof(cpu.instructionCount)==8);
+			emit8(p, 0x48); emit8(p, 0x01); emitField(p, 0, &cpu.cycleCount);
+			// add qword [instructionCount], 1
+			emit8(p, 0x48); emit8(p, 0x83); emitField(p, 0, &cpu.instructionCount); emit8(p, 1);
+			// sub [remainingCycles], rax/eax
+			if (sizeof(cpu.remainingCycles)==8) emit8(p, 0x48);
+			emit8(p, 0x29); emitField(p, 0, &cpu.remainingCycles);
+
+			if (op.mayBankSwitch && i+1<count)
+			{
+				// cmp dword [bankReg], bank; jne leave
+				emit8(p, 0x81); emitField(p, 7, &bankReg); emit32(p, (uint32_t)bank);
+				exits[exitCount++]=emitJcc(p, JNE);
+			}
+
+			assert((size_t)(p-start)<=(size_t)(i+1)*MAX_OP_CODE+MAX_FRAME_CODE);
+		}
+
+		// leave: xor eax, eax
+		uint8_t* const leave=p;
+		emit8(p, 0x31); emit8(p, 0xC0);
+		// done: add rsp, 32; pop rbx; ret
+		uint8_t* const done=p;
+		emit8(p, 0x48); emit8(p, 0x83); emit8(p, 0xC4); emit8(p, 0x20);
+		emit8(p, 0x5B);
+		emit8(p, 0xC3);
+		// fail: mov eax, -1; jmp done
+		uint8_t* const fail=p;
+		emit8(p, 0xB8); emit32(p, 0xFFFFFFFF);
+		emit8(p, 0xEB); emit8(p, (uint8_t)(done-(p+1)));
+
+		for (int i=0;i<exitCount;i++) patch(exits[i], leave);
+		for (int i=0;i<errorCount;i++) patch(errors[i], fail);
+
+		state.codeUsed+=p-start;
+		// keep blocks 16-byte aligned
+		state.codeUsed=(state.codeUsed+15)&~(size_t)15;
+
+		if (!protectCode(state.code, state.codeSize, true))
+		{
+			ERROR(INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_ALLOCATED);
+			state.enabled=false;
+			return nullptr;
+		}
+		return (JITBLOCK)start;
+	}
+
+#else
+	// no native backend on this platform, the interpreter does all the work
+	bool supported()
+	{
+		return false;
+	}
+
+	JITBLOCK compile(JITSTATE& state, const JITOP ops[], const int count, const int& bankReg, const int bank)
+	{
+		return nullptr;
+	}
+#endif
+
+	void reset(JITSTATE& state)
+	{
+		state.codeUsed=0;
+		for (int i=0;i<state.pageCount;i++)
+		{
+			if (state.pages[i]) memset(state.pages[i], 0, sizeof(JITENTRY)*0x2000);
+		}
+	}
+
+	void release(JITSTATE& state)
+	{
+#ifdef JIT_X64
+		if (state.code) freeCode(state.code, state.codeSize);
+#endif
+		state.code=nullptr;
+		state.codeSize=0;
+		state.codeUsed=0;
+
+		for (int i=0;i<state.pageCount;i++)
+		{
+			delete[] state.pages[i];
+		}
+		delete[] state.pages;
+		state.pages=nullptr;
+		state.pageCount=0;
+	}
+}
+
+// unit tests
+class JITTest : public TestCase
+{
+public:
+	virtual const char* name()
+	{
+		return "JIT Unit Test";
+	}
+
+	// runs code on a machine with and one without compiled blocks, they must end up the same
+	void compare(const uint8_t code[], const size_t size)
+	{
+		emu::Machine* interpreted=new emu::Machine();
+		emu::Machine* compiled=new emu::Machine();
+		compiled->enableJIT(true);
+		loadTestProgram(*interpreted, code, size);
+		loadTestProgram(*compiled, code, size);
+
+		// odd slices make blocks stop in the middle
+		for (int i=0;i<1000;i++)
+		{
+			{
+				emu::MachineScope scope(interpreted);
+				tassert(cpu::run(-1, 37));
+			}
+			{
+				emu::MachineScope scope(compiled);
+				tassert(cpu::run(-1, 37));
+			}
+		}
+
+		tassert(compiled->cpu.PC==interpreted->cpu.PC);
+		tassert(compiled->cpu.A==interpreted->cpu.A && compiled->cpu.X==interpreted->cpu.X && compiled->cpu.Y==interpreted->cpu.Y);
+		tassert(valueOf(compiled->cpu.P)==valueOf(interpreted->cpu.P) && compiled->cpu.nz==interpreted->cpu.nz);
+		tassert(compiled->cpu.remainingCycles==interpreted->cpu.remainingCycles);
+		tassert(compiled->cpu.cycleCount==interpreted->cpu.cycleCount);
+		tassert(compiled->cpu.instructionCount==interpreted->cpu.instructionCount);
+		tassert(0==memcmp(compiled->ram.bank0, interpreted->ram.bank0, sizeof(compiled->ram.bank0)));
+		tassert(compiled->cpu.jit.codeUsed>0 || !jit::supported());
+
+		delete compiled;
+		delete interpreted;
+	}
+
+	virtual TestResult run()
+	{
+		// tests run before the emulator is initialized
+		emu::init();
+
+		// $8000: LDX #0
+		// $8002: INX; TXA; CLC; ADC $10; STA $10; STA $0200,X; CPX #$F0; BNE $8002
+		// $8011: LDY $10; JMP $8000
+		static const uint8_t loop[]={
+			0xA2, 0x00,
+			0xE8, 0x8A, 0x18, 0x65, 0x10, 0x85, 0x10, 0x9D, 0x00, 0x02, 0xE0, 0xF0, 0xD0, 0xF2,
+			0xA4, 0x10, 0x4C, 0x00, 0x80};
+		compare(loop, sizeof(loop));
+
+		// the same bank mapped at $8000 and $C000, return addresses on the stack tell the windows apart
+		// $8000: LDX #0
+		// $8002: JSR $C00B; JSR $800B; JMP $8002
+		// $800B: INX; TXA; STA $0300,X; JSR $8014; RTS
+		// $8014: RTS
+		static const uint8_t mirrored[]={
+			0xA2, 0x00,
+			0x20, 0x0B, 0xC0, 0x20, 0x0B, 0x80, 0x4C, 0x02, 0x80,
+			0xE8, 0x8A, 0x9D, 0x00, 0x03, 0x20, 0x14, 0x80, 0x60,
+			0x60};
+		compare(mirrored, sizeof(mirrored));
+
+		// an instruction running into the next bank is left to the interpreter for good
+		// $8000: JMP $9FFE
+		// $9FFE: JMP $8000
+		uint8_t* crossing=new uint8_t[0x2001];
+		memset(crossing, 0xEA, 0x2001);
+		crossing[0]=0x4C; crossing[1]=0xFE; crossing[2]=0x9F;
+		crossing[0x1FFE]=0x4C; crossing[0x1FFF]=0x00; crossing[0x2000]=0x80;
+		compare(crossing, 0x2001);
+		emu::Machine* m=new emu::Machine();
+		m->enableJIT(true);
+		loadTestProgram(*m, crossing, 0x2001);
+		{
+			emu::MachineScope scope(m);
+			tassert(cpu::run(-1, 10000));
+		}
+		if (jit::supported())
+		{
+			tassert(m->cpu.jit.pages[0][0].block!=nullptr);
+			tassert(m->cpu.jit.pages[0][0x1FFE].block==nullptr && m->cpu.jit.pages[0][0x1FFE].visits==JIT_UNCOMPILABLE);
+		}
+		delete m;
+		delete[] crossing;
+		return SUCCESS;
+	}
+};
+
+registerTestCase(JITTest);
@@ -0,0 +1,21 @@
+// instruction handed to the code generator
+struct JITOP
+{
+	const DECODEDOP* op;
+	word_t nextPC; // address of the following instruction
+	bool mayBankSwitch; // writes to memory
+};
+
+// x86-64 backend of the call-threading code generator
+namespace jit
+{
+	bool supported();
+
+	// translate a run of instructions from one prg-rom bank, null when the code buffer is full.
+	// bankReg is the mmc register that must still hold bank for the block to continue.
+	JITBLOCK compile(JITSTATE& state, const JITOP ops[], const int count, const int& bankReg, const int bank);
+
+	// drop all compiled code
+	void reset(JITSTATE& state);
+	void release(JITSTATE& state);
+}
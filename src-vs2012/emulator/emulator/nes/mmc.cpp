@@ -11,118 +11,210 @@
 #include "mmc.h"
 #include "cpu.h"
 #include "ppu.h"
+#include "emu.h"
 
 #include "../ui.h"
 
-// NES main memory
-__declspec(align(0x1000))
-struct NESRAM ram;
+// bank-switching state of the active machine
+static FORCE_INLINE MMCSTATE& mmcState()
+{
+	return emu::active().mmc;
+}
+
+// registers of the active machine's mapper
+static FORCE_INLINE MAPPERSTATE& mapperState()
+{
+	return emu::active().mapper;
+}
 
 namespace mmc
 {
-	// addresses of currently selected prg-rom banks.
-	static int p8, pA, pC, pE;
+	// prg-rom visible before the mapper selects any bank
+	static const uint8_t unmappedBank[0x2000]={0};
 
-	static bool sramEnabled;
+	// point the pages of a prg-rom bank at the rom mapped there
+	static void mapPRGPages(const int index)
+	{
+		for (int i=0;i<0x20;i++)
+			mmcState().pages[0x80+index*0x20+i].read=emu::ram().prg[index]+i*0x100;
+	}
 
-	static void updateBank(uint8_t * const dest, int& prev, int current)
+	static void updateBank(const int index, int& prev, int current)
 	{
 		// first mask bank the address
 		current = mapper::maskPRG(current, rom::count8KPRG());
 		assert(current<rom::count8KPRG());
 
-		if (current!=prev)
-		{
-			// perform update
-			memcpy(dest, rom::getImage()+current*0x2000, 0x2000);
-			prev=current;
-		}
+		// map the bank in place, no copy
+		emu::ram().prg[index]=(const uint8_t*)rom::getImage()+current*0x2000;
+		mapPRGPages(index);
+		prev=current;
 	}
 
 	// perform bank switching
 	void bankSwitch(int reg8, int regA, int regC, int regE)
 	{
-		if (reg8!=INVALID) updateBank(ram.bank8, p8, reg8);
-		if (regA!=INVALID) updateBank(ram.bankA, pA, regA);
-		if (regC!=INVALID) updateBank(ram.bankC, pC, regC);
-		if (regE!=INVALID) updateBank(ram.bankE, pE, regE);
+		if (reg8!=INVALID) updateBank(0, mmcState().p8, reg8);
+		if (regA!=INVALID) updateBank(1, mmcState().pA, regA);
+		if (regC!=INVALID) updateBank(2, mmcState().pC, regC);
+		if (regE!=INVALID) updateBank(3, mmcState().pE, regE);
 	}
 
 	void setSRAMEnabled(bool v)
 	{
-		sramEnabled=v;
+		mmcState().sramEnabled=v;
+	}
+
+	//[$2000,$4000) PPU Registers
+	static byte_t readPPU(const maddr_t addr)
+	{
+		byte_t ret=INVALID;
+		if (ppu::readPort(addr, ret)) return ret;
+		ERROR(INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_READ, "addr", valueOf(addr));
+		return ret;
+	}
+
+	static void writePPU(const maddr_t addr, const byte_t value)
+	{
+		if (ppu::writePort(addr, value)) return;
+		ERROR(INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_WRITTEN, "addr", valueOf(addr), "value", value);
+	}
+
+	//[$4000,$6000) Other Registers
+	static byte_t readIO(const maddr_t addr)
+	{
+		switch (valueOf(addr))
+		{
+		case 0x4015: // APU Register
+			return 0;
+		case 0x4016: // Input Registers
+		case 0x4017:
+			if (ui::hasInput((addr==0x4017)?1:0))
+				return ui::readInput((addr==0x4017)?1:0); // outputs button state
+			else
+				return 0; // joystick not connected
+		}
+		ERROR(INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_READ, "addr", valueOf(addr));
+		return INVALID;
+	}
+
+	static void writeIO(const maddr_t addr, const byte_t value)
+	{
+		switch (valueOf(addr))
+		{
+		// SPR-RAM DMA Pointer Register
+		case 0x4014:
+			ERROR_UNLESS(value<0x8, INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_COPIED, "page", value);
+			ppu::dma(ramPg(value));
+			return;
+		// Input Registers 
+		case 0x4016:
+		case 0x4017:
+			if (!(value&1))
+			{
+				ui::resetInput();
+			}
+			return;
+		}
+		if (addr>=0x4000 && addr<=0x4017)
+		{
+			// APU Registers
+			return;
+		}
+		ERROR(INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_WRITTEN, "addr", valueOf(addr), "value", value);
+	}
+
+	//[$8000,$FFFF] without mapper registers
+	static void writeUnmapped(const maddr_t addr, const byte_t value)
+	{
+		ERROR(INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_WRITTEN, "addr", valueOf(addr), "value", value);
+	}
+
+	// lay out the cpu address space, the mapper adds its registers on setup
+	static void mapPages()
+	{
+		for (int i=0;i<0x100;i++)
+		{
+			MEMPAGE& page=mmcState().pages[i];
+			page.read=nullptr;
+			page.write=nullptr;
+			page.readHandler=nullptr;
+			page.writeHandler=nullptr;
+			if (i<0x20) // Internal RAM, mirrored every 2K
+			{
+				page.write=&emu::ram().bank0[(i&7)<<8];
+				page.read=page.write;
+			}
+			else if (i<0x40)
+			{
+				page.readHandler=readPPU;
+				page.writeHandler=writePPU;
+			}
+			else if (i<0x60)
+			{
+				page.readHandler=readIO;
+				page.writeHandler=writeIO;
+			}
+			else if (i<0x80) // SRAM
+			{
+				page.write=&emu::ram().bank6[(i-0x60)<<8];
+				page.read=page.write;
+			}
+			else
+			{
+				page.writeHandler=writeUnmapped;
+			}
+		}
+		for (int i=0;i<4;i++)
+			mapPRGPages(i);
 	}
 
 	void reset()
 	{
 		// no prg-rom selected now
-		p8=INVALID;
-		pA=INVALID;
-		pC=INVALID;
-		pE=INVALID;
+		mmcState().p8=INVALID;
+		mmcState().pA=INVALID;
+		mmcState().pC=INVALID;
+		mmcState().pE=INVALID;
 
 		// SRAM is disabled by default
-		sramEnabled = false;
+		mmcState().sramEnabled = false;
 
 		// clear memory
-		memset(&ram,0,sizeof(ram));
+		memset(&emu::ram(),0,sizeof(emu::ram()));
+		for (int i=0;i<4;i++)
+			emu::ram().prg[i]=unmappedBank;
+		mapPages();
 	}
 
-	void save(FILE *fp)
+	void save(SNAPSHOT& s)
 	{
 		// bank-switching state
-		fwrite(&p8, sizeof(p8), 1, fp);
-		fwrite(&pA, sizeof(pA), 1, fp);
-		fwrite(&pC, sizeof(pC), 1, fp);
-		fwrite(&pE, sizeof(pE), 1, fp);
-
-		// data in memory
-		fwrite(ram.bank0, sizeof(ram.bank0), 1, fp);
-		fwrite(ram.bank6, sizeof(ram.bank6), 1, fp);
-
-#ifdef SAVE_COMPLETE_MEMORY
-		// code in memory
-		fwrite(ram.code, sizeof(ram.code), 1, fp);
-#endif
+		s.prgBanks[0]=mmcState().p8;
+		s.prgBanks[1]=mmcState().pA;
+		s.prgBanks[2]=mmcState().pC;
+		s.prgBanks[3]=mmcState().pE;
+		s.saveRamEnabled=mmcState().sramEnabled?1:0;
+
+		// data in memory, code stays in the rom image
+		memcpy(s.cpuRam, emu::ram().bank0, sizeof(s.cpuRam));
+		memcpy(s.saveRam, emu::ram().bank6, sizeof(s.saveRam));
 	}
 	
-	void load(FILE *fp)
+	void load(const SNAPSHOT& s)
 	{
-		// bank-switching state
-		int r8, rA, rC, rE;
-		fread(&r8, sizeof(r8), 1, fp);
-		fread(&rA, sizeof(rA), 1, fp);
-		fread(&rC, sizeof(rC), 1, fp);
-		fread(&rE, sizeof(rE), 1, fp);
-
-		// data in memory
-		fread(ram.bank0, sizeof(ram.bank0), 1, fp);
-		fread(ram.bank6, sizeof(ram.bank6), 1, fp);
-
-#ifdef SAVE_COMPLETE_MEMORY
-		// code in memory
-		fwrite(ram.code, sizeof(ram.code), 1, fp);
-		p8 = r8;
-		pA = rA;
-		pC = rC;
-		pE = rE;
-#else
-		// restore code
-		bankSwitch(r8, rA, rC, rE);
-#endif
+		memcpy(emu::ram().bank0, s.cpuRam, sizeof(s.cpuRam));
+		memcpy(emu::ram().bank6, s.saveRam, sizeof(s.saveRam));
+		mmcState().sramEnabled=s.saveRamEnabled!=0;
+
+		// map code back in
+		bankSwitch(s.prgBanks[0], s.prgBanks[1], s.prgBanks[2], s.prgBanks[3]);
 	}
 
+	// where code runs from and operands wrapping around $FFFF are left to the checked cpu handlers
 	opcode_t fetchOpcode(maddr_t& pc)
 	{
-		opcode_t opcode;
-#ifdef WANT_MEM_PROTECTION
-		// check if address in code section [$8000, $FFFF]
-		FATAL_ERROR_UNLESS(valueOf(pc)>=0x6000, INVALID_MEMORY_ACCESS, MEMORY_NOT_EXECUTABLE, "PC", valueOf(pc));
-		opcode = ram.bank8[pc-0x8000];
-#else
-		WARN_IF(!MSB(pc), INVALID_MEMORY_ACCESS, MEMORY_NOT_EXECUTABLE, "PC", valueOf(pc));
-		opcode = ram.data(pc);
-#endif
+		const opcode_t opcode = emu::ram().data(pc);
 		inc(pc);
 		return opcode;
 	}
@@ -130,11 +222,7 @@ namespace mmc
 	operandb_t fetchByteOperand(maddr_t& pc)
 	{
 		operandb_t operand;
-#ifdef WANT_MEM_PROTECTION
-		operand(ram.bank8[pc-0x8000]);
-#else
-		operand(ram.data(pc));
-#endif
+		operand(emu::ram().data(pc));
 		inc(pc);
 		return operand;
 	}
@@ -142,12 +230,7 @@ namespace mmc
 	operandw_t fetchWordOperand(maddr_t& pc)
 	{
 		operandw_t operand;
-		FATAL_ERROR_IF(pc.reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
-#ifdef WANT_MEM_PROTECTION
-		operand(*(uint16_t*)&ram.bank8[pc-0x8000]);
-#else
-		operand(makeWord(ram.data(pc), ram.data(pc+1)));
-#endif
+		operand(makeWord(emu::ram().data(pc), emu::ram().data(pc.plus(1))));
 		pc+=2;
 		return operand;
 	}
@@ -157,208 +240,41 @@ namespace mmc
 		return ram0p[zp];
 	}
 
+	// pointers at $FF wrap around to $00, the checked cpu handlers stop at them instead
 	word_t loadZPWord(const maddr8_t zp)
 	{
-#ifndef ALLOW_ADDRESS_WRAP
-		FATAL_ERROR_IF(zp.reachMax(), INVALID_MEMORY_ACCESS, ILLEGAL_ADDRESS_WARP);
-#else
 		if (zp.reachMax())
 		{
 			 return (((word_t)ram0p[0])<<8)|ram0p[zp];
 		}
-#endif
 		return *(uint16_t*)&ram0p[zp];
 	}
 
 	byte_t read(const maddr_t addr)
 	{
-		byte_t ret=INVALID;
-		switch (addr>>13) // bank number/2
-		{
-		case 0: //[$0000,$2000)
-			return ram.bank0[addr&0x7FF];
-		case 1: //[$2000,$4000)
-			if (ppu::readPort(addr, ret)) return ret;
-			break;
-		case 2: //[$4000,$6000)
-			switch (valueOf(addr))
-			{
-			case 0x4015: // APU Register
-				return 0;
-			case 0x4016: // Input Registers
-			case 0x4017:
-				if (ui::hasInput((addr==0x4017)?1:0))
-					return ui::readInput((addr==0x4017)?1:0); // outputs button state
-				else
-					return 0; // joystick not connected
-			}
-			break;
-		case 3:
-			return ram.bank6[addr&0x1FFF];
-		case 4:
-		case 5:
-		case 6:
-		case 7:
-			return ram.bank8[addr-0x8000];
-		}
-		ERROR(INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_READ, "addr", valueOf(addr));
-		return ret;
+		const MEMPAGE& page=mmcState().pages[valueOf(addr)>>8];
+		if (page.read!=nullptr) return page.read[valueOf(addr)&0xFF];
+		return page.readHandler(addr);
 	}
 
 	void write(const maddr_t addr, const byte_t value)
 	{
-		switch (addr>>13) // bank number/2
-		{
-			case 0: //[$0000,$2000) Internal RAM
-				ram.bank0[addr&0x7FF]=value;
-				return;
-			case 1: //[$2000,$4000) PPU Registers
-				if (ppu::writePort(addr, value)) return;
-				break;
-			case 3: //[$6000,$8000) SRAM
-				ram.bank6[addr&0x1FFF]=value;
-				return;
-			case 4: //[$8000,$A000)
-			case 5: //[$A000,$C000)
-			case 6: //[$C000,$E000)
-			case 7: //[$E000,$FFFF]
-				//  mapper write
-				if (mapper::write(addr, value)) return;
-				break;
-			case 2: //[$4000,$6000) Other Registers
-				switch (valueOf(addr))
-				{
-				// SPR-RAM DMA Pointer Register
-				case 0x4014:
-					ERROR_UNLESS(value<0x8, INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_COPIED, "page", value);
-					ppu::dma(ramPg(value));
-					return;
-				// Input Registers 
-				case 0x4016:
-				case 0x4017:
-					if (!(value&1))
-					{
-						ui::resetInput();
-					}
-					return;
-				}
-				if (addr>=0x4000 && addr<=0x4017)
-				{
-					// APU Registers
-					return;
-				}
-				break;
-		}
-		ERROR(INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_WRITTEN, "addr", valueOf(addr), "value", value);
-	}
-}
-
-namespace mapper
-{
-	// MMC1 registers
-	static ioreg_t mmc1Sel; // register select
-	static ioreg_t mmc1Pos;
-	static ioreg_t mmc1Tmp;
-	static flag_set<ioreg_t, MMC1REG, 5> mmc1Regs[4];
-	#define mmc1Cfg mmc1Regs[0]
-
-	// MMC3 registers
-	static ioreg_t mmc3Control;
-	static ioreg_t mmc3Cmd;
-	static ioreg_t mmc3Data;
-	static ioreg_t mmc3Counter;
-	static ioreg_t mmc3Latch;
-	static bool mmc3IRQ;
-
-	void reset()
-	{
-		// MMC1
-		mmc1Sel=INVALID;
-		mmc1Tmp=0;
-		mmc1Pos=0;
-		for (int i=0; i<4; i++)
-		{
-			mmc1Regs[i].clearAll();
-		}
-
-		// MMC3
-		mmc3Control=INVALID;
-		mmc3Cmd=0;
-		mmc3Data=0;
-		mmc3Counter=0;
-		mmc3Latch=INVALID;
-		mmc3IRQ=false;
-	}
-
-	void load(FILE* fp)
-	{
-		fread(&mmc1Sel, sizeof(mmc1Sel), 1, fp);
-		fread(&mmc1Pos, sizeof(mmc1Pos), 1, fp);
-		fread(&mmc1Tmp, sizeof(mmc1Tmp), 1, fp);
-		fread(&mmc1Regs, sizeof(mmc1Regs), 1, fp);
-
-		fread(&mmc3Control, sizeof(mmc3Control), 1, fp);
-		fread(&mmc3Cmd, sizeof(mmc3Cmd), 1, fp);
-		fread(&mmc3Data, sizeof(mmc3Data), 1, fp);
-		fread(&mmc3Counter, sizeof(mmc3Counter), 1, fp);
-		fread(&mmc3Latch, sizeof(mmc3Latch), 1, fp);
-		fread(&mmc3IRQ, sizeof(mmc3IRQ), 1, fp);
+		const MEMPAGE& page=mmcState().pages[valueOf(addr)>>8];
+		if (page.write!=nullptr) page.write[valueOf(addr)&0xFF]=value;
+		else page.writeHandler(addr, value);
 	}
 
-	void save(FILE* fp)
+	// writes to $8000-$FFFF go to the mapper registers, null if the board has none
+	void setRegisterHandler(WRITEHANDLER handler)
 	{
-		fwrite(&mmc1Sel, sizeof(mmc1Sel), 1, fp);
-		fwrite(&mmc1Pos, sizeof(mmc1Pos), 1, fp);
-		fwrite(&mmc1Tmp, sizeof(mmc1Tmp), 1, fp);
-		fwrite(&mmc1Regs, sizeof(mmc1Regs), 1, fp);
-
-		fwrite(&mmc3Control, sizeof(mmc3Control), 1, fp);
-		fwrite(&mmc3Cmd, sizeof(mmc3Cmd), 1, fp);
-		fwrite(&mmc3Data, sizeof(mmc3Data), 1, fp);
-		fwrite(&mmc3Counter, sizeof(mmc3Counter), 1, fp);
-		fwrite(&mmc3Latch, sizeof(mmc3Latch), 1, fp);
-		fwrite(&mmc3IRQ, sizeof(mmc3IRQ), 1, fp);
-	}
-
-	bool setup()
-	{
-		switch (rom::mapperType())
-		{
-		case 0: // no mapper
-		case 2: // Mapper 2: UNROM - PRG/16K
-		case 3: // Mapper 3: CNROM - VROM/8K
-		case 7: // Mapper 7: AOROM - PRG/32K, Name Table Select
-			if (rom::sizeOfImage() >= 0x8000) // 32K of code or more
-				mmc::bankSwitch(0, 1, 2, 3);
-			else if (rom::sizeOfImage() == 0x4000) // 16K of code
-				mmc::bankSwitch(0, 1, 0, 1);
-			else
-			{
-invalidROMSize:
-				ERROR(INVALID_MEMORY_ACCESS, MAPPER_FAILURE, "image size", rom::sizeOfImage());
-				return false;
-			}
-			return true;		
-		case 1: // Mapper 1: MMC1
-			if (rom::count16KPRG()>=1 && rom::count16KPRG()<=16) // at least 16K of code, at most 256K of code
-			{
-				mmc::bankSwitch(0, 1, rom::count8KPRG()-2, rom::count8KPRG()-1);
-				return true;
-			}
-			goto invalidROMSize;
-		case 4: // Mapper 4: MMC3 - PRG/8K, VROM/2K/1K, VT, SRAM, IRQ
-			if (rom::count8KPRG()>=2)
-			{
-				mmc::bankSwitch(0, 1, rom::count8KPRG()-2, rom::count8KPRG()-1);
-				return true;
-			}
-			goto invalidROMSize;
-		}
-		// unknown mapper
-		FATAL_ERROR(INVALID_ROM, UNSUPPORTED_MAPPER_TYPE, "mapper", rom::mapperType());
-		return false;
+		if (handler==nullptr) handler=writeUnmapped;
+		for (int i=0x80;i<0x100;i++)
+			mmcState().pages[i].writeHandler=handler;
 	}
+}
 
+namespace mapper
+{
 	byte_t maskPRG(byte_t bank, const byte_t count)
 	{
 		assert(count!=0);
@@ -384,255 +300,467 @@ invalidROMSize:
 		mmc::bankSwitch((value<<2), (value<<2)+1, (value<<2)+2, (value<<2)+3);
 	}
 
-	bool write(const maddr_t addr, const byte_t value)
+	// a cartridge board: how it maps prg-rom at power-up, what its registers do and what it does at the end of scanlines.
+	// boards are never instantiated, each one only defines the hooks it needs and inherits the others from here.
+	struct Board
 	{
-		switch (rom::mapperType())
+		// 16K of code is mirrored, 32K is mapped as it is
+		static bool setup()
 		{
-		case 0: // no mapper
-			return false;
-		case 1: // Mapper 1:
-			return mmc1Write(addr, value);
-		case 2: // Mapper 2: Select 16K ROM
-			selectFirst16KROM(value);
-			return true;
-		case 3: // Mapper 3: Select 8K VROM
-			pmapper::select8KVROM(value&3);
-			return true;
-		case 4: // MMC3:
-			return mmc3Write(addr, value);
-		case 7: // Mapper 7: Select 32K ROM & Name Table Select
-			select32KROM(value&7);
-			rom::setMirrorMode((value&16)?MIRRORING::HSINGLESCREEN:MIRRORING::LSINGLESCREEN);
+			if (rom::sizeOfImage() >= 0x8000) // 32K of code or more
+				mmc::bankSwitch(0, 1, 2, 3);
+			else if (rom::sizeOfImage() == 0x4000) // 16K of code
+				mmc::bankSwitch(0, 1, 0, 1);
+			else
+				return invalidSize();
 			return true;
 		}
-		FATAL_ERROR(INVALID_MEMORY_ACCESS, MAPPER_FAILURE, "addr", valueOf(addr), "value", value, "mapper", rom::mapperType());
-		return false;
-	}
 
-	void HBlank()
-	{
-		switch (rom::mapperType())
+		static bool invalidSize()
 		{
-			case 4: // MMC3:
-				mmc3HBlank();
-				break;
+			ERROR(INVALID_MEMORY_ACCESS, MAPPER_FAILURE, "image size", rom::sizeOfImage());
+			return false;
 		}
-	}
 
-	// various mapper handlers
-	static void mmc1Apply(const byte_t sel)
+		// no registers
+		static void write(const maddr_t addr, const byte_t value)
+		{
+			ERROR(INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_WRITTEN, "addr", valueOf(addr), "value", value);
+		}
+
+		static void HBlank()
+		{
+		}
+
+		static int nextEventLine(const int /*scanline*/)
+		{
+			return NO_EVENT;
+		}
+
+		static void skipScanlines(const int /*scanline*/, const int /*count*/)
+		{
+		}
+	};
+
+	// Mapper 0: no mapper
+	struct NROM : Board
 	{
-		byte_t value=mmc1Regs[sel](MMC1REG::MASK);
-		switch (sel)
+	};
+
+	// Mapper 1: MMC1
+	struct MMC1 : Board
+	{
+		static bool setup()
 		{
-		case 0: // Configuration Register
-			// configure mirroring
-			switch (mmc1Cfg(MMC1REG::NT_MIRRORING))
+			if (rom::count16KPRG()>=1 && rom::count16KPRG()<=16) // at least 16K of code, at most 256K of code
 			{
-			case 0:
-				rom::setMirrorMode(MIRRORING::LSINGLESCREEN);
+				mmc::bankSwitch(0, 1, rom::count8KPRG()-2, rom::count8KPRG()-1);
+				return true;
+			}
+			return invalidSize();
+		}
+
+		static void apply(const byte_t sel)
+		{
+			byte_t value=mapperState().mmc1Regs[sel](MMC1REG::MASK);
+			switch (sel)
+			{
+			case 0: // Configuration Register
+				// configure mirroring
+				switch (mapperState().mmc1Regs[0](MMC1REG::NT_MIRRORING))
+				{
+				case 0:
+					rom::setMirrorMode(MIRRORING::LSINGLESCREEN);
+					break;
+				case 1:
+					rom::setMirrorMode(MIRRORING::HSINGLESCREEN);
+					break;
+				case 2:
+					rom::setMirrorMode(MIRRORING::VERTICAL);
+					break;
+				case 3:
+					rom::setMirrorMode(MIRRORING::HORIZONTAL);
+					break;
+				}
 				break;
-			case 1:
-				rom::setMirrorMode(MIRRORING::HSINGLESCREEN);
+
+			case 1: // Select 4K or 8K VROM bank at 0000h
+				if (rom::count8KCHR()>0)
+				{
+					if (mapperState().mmc1Regs[0][MMC1REG::VROM_SWITCH_MODE])
+					{
+						// 4K
+						ERROR_IF((int)value>=rom::count4KCHR(), INVALID_MEMORY_ACCESS, MAPPER_FAILURE, "bankSize", 4, "num", value);
+						pmapper::selectVROM(4, value, 0);
+					}else
+					{
+						// 8K
+						ERROR_IF((int)value>=rom::count8KCHR(), INVALID_MEMORY_ACCESS, MAPPER_FAILURE, "bankSize", 8, "num", value);
+						pmapper::select8KVROM(value);
+					}
+				}
 				break;
-			case 2:
-				rom::setMirrorMode(MIRRORING::VERTICAL);
+
+			case 2: // Select 4K VROM bank at 1000h (4K mode only)
+				if (rom::count8KCHR()>0)
+				{
+					FATAL_ERROR_IF(mapperState().mmc1Regs[0][MMC1REG::VROM_SWITCH_MODE], ILLEGAL_OPERATION, MAPPER_FAILURE, "mmc1reg2", value);
+					ERROR_IF((int)value>=rom::count4KCHR(), INVALID_MEMORY_ACCESS, MAPPER_FAILURE, "bankSize", 4, "num", value);
+					pmapper::selectVROM(4, value, 1);
+				}
 				break;
-			case 3:
-				rom::setMirrorMode(MIRRORING::HORIZONTAL);
+
+			case 3: // Select 16K or 2x16K ROM bank
+				value=mapperState().mmc1Regs[sel](MMC1REG::PRG_BANK);
+				switch (mapperState().mmc1Regs[0](MMC1REG::PRG_SWITCH_MODE))
+				{
+				case 0:
+				case 1: // Switchable 32K Area at 8000h-FFFFh
+					select32KROM(value);
+					break;
+				case 2: // Switchable 16K Area at C000h-FFFFh
+					mmc::bankSwitch(0, 1, (value<<1), (value<<1)+1);
+					break;
+				case 3: // Switchable 16K Area at 8000h-BFFFh
+					mmc::bankSwitch((value<<1), (value<<1)+1, rom::count8KPRG()-2, rom::count8KPRG()-1);
+					break;
+				}
 				break;
 			}
-			break;
+		}
 
-		case 1: // Select 4K or 8K VROM bank at 0000h
-			if (rom::count8KCHR()>0)
+		static void write(const maddr_t addr, const byte_t value)
+		{
+			// And I hope the address is multiple of 0x2000.
+			vassert(0==(addr&0x1FFF));
+
+			const byte_t i=(valueOf(addr)>>13)&3;
+			vassert(i<4);
+			assert(mapperState().mmc1Sel==INVALID || mapperState().mmc1Sel==i);
+			mapperState().mmc1Sel=i;
+
+			if (value&0x80)
 			{
-				if (mmc1Cfg[MMC1REG::VROM_SWITCH_MODE])
-				{
-					// 4K
-					ERROR_IF((int)value>=rom::count4KCHR(), INVALID_MEMORY_ACCESS, MAPPER_FAILURE, "bankSize", 4, "num", value);
-					pmapper::selectVROM(4, value, 0);
-				}else
+				// clear shift register
+				mapperState().mmc1Regs[0].asBitField()=valueOf(mapperState().mmc1Regs[0])|0xC; // ?
+				mapperState().mmc1Pos=0;
+				mapperState().mmc1Tmp=0;
+				mapperState().mmc1Sel=INVALID;
+			}else
+			{
+				// D1-D7 had better be zero.
+				//vassert(0==(value&0xFE));
+
+				// serial load (LSB first)
+				vassert(mapperState().mmc1Pos<5);
+				mapperState().mmc1Tmp&=~(1<<mapperState().mmc1Pos);
+				mapperState().mmc1Tmp|=((value&1)<<mapperState().mmc1Pos);
+
+				// increase position
+				mapperState().mmc1Pos++;
+				if (mapperState().mmc1Pos==5)
 				{
-					// 8K
-					ERROR_IF((int)value>=rom::count8KCHR(), INVALID_MEMORY_ACCESS, MAPPER_FAILURE, "bankSize", 8, "num", value);
-					pmapper::select8KVROM(value);
+					// fifth write
+					// copy to selected register
+					mapperState().mmc1Regs[i].asBitField()=mapperState().mmc1Tmp;
+					apply(mapperState().mmc1Sel);
+					// reset
+					mapperState().mmc1Pos=0;
+					mapperState().mmc1Tmp=0; // optional
+					mapperState().mmc1Sel=INVALID;
 				}
 			}
-			break;
+		}
+	};
+
+	// Mapper 2: UNROM - PRG/16K
+	struct UNROM : Board
+	{
+		static void write(const maddr_t /*addr*/, const byte_t value)
+		{
+			selectFirst16KROM(value);
+		}
+	};
 
-		case 2: // Select 4K VROM bank at 1000h (4K mode only)
-			if (rom::count8KCHR()>0)
+	// Mapper 3: CNROM - VROM/8K
+	struct CNROM : Board
+	{
+		static void write(const maddr_t /*addr*/, const byte_t value)
+		{
+			pmapper::select8KVROM(value&3);
+		}
+	};
+
+	// Mapper 4: MMC3 - PRG/8K, VROM/2K/1K, VT, SRAM, IRQ
+	struct MMC3 : Board
+	{
+		static bool setup()
+		{
+			if (rom::count8KPRG()>=2)
 			{
-				FATAL_ERROR_IF(mmc1Cfg[MMC1REG::VROM_SWITCH_MODE], ILLEGAL_OPERATION, MAPPER_FAILURE, "mmc1reg2", value);
-				ERROR_IF((int)value>=rom::count4KCHR(), INVALID_MEMORY_ACCESS, MAPPER_FAILURE, "bankSize", 4, "num", value);
-				pmapper::selectVROM(4, value, 1);
+				mmc::bankSwitch(0, 1, rom::count8KPRG()-2, rom::count8KPRG()-1);
+				return true;
 			}
-			break;
+			return invalidSize();
+		}
+
+		static void apply()
+		{
+			FATAL_ERROR_IF(mapperState().mmc3Control==INVALID, ILLEGAL_OPERATION, MAPPER_FAILURE, "mmc3data", mapperState().mmc3Data);
+			
+			const bool CHRSelect=(mapperState().mmc3Control&0x80)==0x80;
+			const bool PRGSelect=(mapperState().mmc3Control&0x40)==0x40;
 
-		case 3: // Select 16K or 2x16K ROM bank
-			value=mmc1Regs[sel](MMC1REG::PRG_BANK);
-			switch (mmc1Cfg(MMC1REG::PRG_SWITCH_MODE))
+			switch (mapperState().mmc3Cmd) // Command Number
 			{
-			case 0:
-			case 1: // Switchable 32K Area at 8000h-FFFFh
-				select32KROM(value);
+			case 0: // Select 2x1K VROM at PPU 0000h-07FFh
+				//assert(0==(mmc3Data&1));
+				//pmapper::selectVROM(2, mmc3Data>>1, CHRSelect?2:0); 
+				pmapper::selectVROM(1, mapperState().mmc3Data, CHRSelect?4:0);  
+				pmapper::selectVROM(1, mapperState().mmc3Data+1, CHRSelect?5:1);
+				break;
+			case 1: // Select 2x1K VROM at PPU 0800h-0FFFh
+				//assert(0==(mmc3Data&1));
+				//pmapper::selectVROM(2, mmc3Data>>1, CHRSelect?3:1); 
+				pmapper::selectVROM(1, mapperState().mmc3Data, CHRSelect?6:2); 
+				pmapper::selectVROM(1, mapperState().mmc3Data+1, CHRSelect?7:3); 
+				break;
+			case 2: // Select 1K VROM at PPU 1000h-13FFh
+				pmapper::selectVROM(1, mapperState().mmc3Data, CHRSelect?0:4);
 				break;
-			case 2: // Switchable 16K Area at C000h-FFFFh
-				mmc::bankSwitch(0, 1, (value<<1), (value<<1)+1);
+			case 3: // Select 1K VROM at PPU 1400h-17FFh
+				pmapper::selectVROM(1, mapperState().mmc3Data, CHRSelect?1:5);
 				break;
-			case 3: // Switchable 16K Area at 8000h-BFFFh
-				mmc::bankSwitch((value<<1), (value<<1)+1, rom::count8KPRG()-2, rom::count8KPRG()-1);
+			case 4: // Select 1K VROM at PPU 1800h-1BFFh
+				pmapper::selectVROM(1, mapperState().mmc3Data, CHRSelect?2:6);
+				break;
+			case 5: // Select 1K VROM at PPU 1C00h-1FFFh
+				pmapper::selectVROM(1, mapperState().mmc3Data, CHRSelect?3:7);
+				break;
+			case 6: // Select 8K ROM at 8000h-9FFFh
+				if (!PRGSelect)
+					mmc::bankSwitch(mapperState().mmc3Data, INVALID, rom::count8KPRG()-2, rom::count8KPRG()-1);
+				else
+					mmc::bankSwitch(rom::count8KPRG()-2, INVALID, mapperState().mmc3Data, rom::count8KPRG()-1);
+				break;
+			case 7: // Select 8K ROM at A000h-BFFFh
+				if (!PRGSelect)
+					mmc::bankSwitch(INVALID, mapperState().mmc3Data, rom::count8KPRG()-2, rom::count8KPRG()-1);
+				else
+					mmc::bankSwitch(rom::count8KPRG()-2, mapperState().mmc3Data, INVALID, rom::count8KPRG()-1);
 				break;
 			}
-			break;
 		}
-	}
-
-	bool mmc1Write(const maddr_t addr, const byte_t value)
-	{
-		// And I hope the address is multiple of 0x2000.
-		vassert(0==(addr&0x1FFF));
 
-		const byte_t i=(valueOf(addr)>>13)&3;
-		vassert(i<4);
-		assert(mmc1Sel==INVALID || mmc1Sel==i);
-		mmc1Sel=i;
+		static bool writeRegister(const maddr_t addr, const byte_t value)
+		{
+			switch (valueOf(addr))
+			{
+			case 0x8000: // Index/Control (5bit)
+				mapperState().mmc3Cmd=value&7;
+				mapperState().mmc3Control=value;
+				return true;
+			case 0x8001: // Data Register
+				mapperState().mmc3Data=value;
+				apply();
+				return true;
+			case 0xA000: // Mirroring Select
+				rom::setMirrorMode((value&1)?MIRRORING::HORIZONTAL:MIRRORING::VERTICAL);
+				return true;
+			case 0xA001: // SaveRAM Toggle
+				mmc::setSRAMEnabled((value&1)==1);
+				return true;
+			case 0xC000: // IRQ Counter Register
+				mapperState().mmc3Counter=value;
+				return true;
+			case 0xC001: // IRQ Latch Register
+				mapperState().mmc3Latch=value;
+				return true;
+			case 0xE000: // IRQ Control Register 0
+				mapperState().mmc3IRQ=false;
+				mapperState().mmc3Counter=mapperState().mmc3Latch;
+				return true;
+			case 0xE001: // IRQ Control Register 1
+				mapperState().mmc3IRQ=true;
+				return true;
+			}
+			return false;
+		}
 
-		if (value&0x80)
+		static void write(const maddr_t addr, const byte_t value)
 		{
-			// clear shift register
-			mmc1Regs[0].asBitField()=valueOf(mmc1Regs[0])|0xC; // ?
-			mmc1Pos=0;
-			mmc1Tmp=0;
-			mmc1Sel=INVALID;
-			return true;
-		}else
+			// the irq registers move the line the counter reaches zero at
+			ppu::catchUp();
+			if (!writeRegister(addr, value))
+				Board::write(addr, value);
+			ppu::reschedule();
+		}
+
+		static void HBlank()
 		{
-			// D1-D7 had better be zero.
-			//vassert(0==(value&0xFE));
+			if (ppu::currentScanline()==-1)
+				mapperState().mmc3Counter=mapperState().mmc3Latch;
+			else if (ppu::currentScanline()>=0 && ppu::currentScanline()<=239)
+			{
+				if (mapperState().mmc3IRQ && render::enabled())
+				{
+					mapperState().mmc3Counter=(mapperState().mmc3Counter-1)&0xFF;
+					if (!mapperState().mmc3Counter)
+					{
+						cpu::irq(IRQTYPE::IRQ);
+					}
+				}
+			}
+		}
 
-			// serial load (LSB first)
-			vassert(mmc1Pos<5);
-			mmc1Tmp&=~(1<<mmc1Pos);
-			mmc1Tmp|=((value&1)<<mmc1Pos);
+		static int nextEventLine(const int scanline)
+		{
+			if (scanline==-1) return scanline; // counter reload
+			if (scanline>=0 && scanline<=239 && mapperState().mmc3IRQ && render::enabled())
+			{
+				// the irq fires on the line that clocks the counter to zero
+				const int line=scanline+((mapperState().mmc3Counter-1)&0xFF);
+				if (line<=239) return line;
+			}
+			return NO_EVENT;
+		}
 
-			// increase position
-			mmc1Pos++;
-			if (mmc1Pos==5)
+		static void skipScanlines(const int scanline, const int count)
+		{
+			if (scanline>=0 && scanline<=239 && mapperState().mmc3IRQ && render::enabled())
 			{
-				// fifth write
-				// copy to selected register
-				mmc1Regs[i].asBitField()=mmc1Tmp;
-				mmc1Apply(mmc1Sel);
-				// reset
-				mmc1Pos=0;
-				mmc1Tmp=0; // optional
-				mmc1Sel=INVALID;
+				assert(mapperState().mmc3Counter==0 || (ioreg_t)count<mapperState().mmc3Counter);
+				mapperState().mmc3Counter=(mapperState().mmc3Counter-count)&0xFF;
 			}
-			return true;
 		}
-		return false;
-	}
+	};
 
-	static void mmc3Apply()
+	// Mapper 7: AOROM - PRG/32K, Name Table Select
+	struct AOROM : Board
 	{
-		FATAL_ERROR_IF(mmc3Control==INVALID, ILLEGAL_OPERATION, MAPPER_FAILURE, "mmc3data", mmc3Data);
-		
-		const bool CHRSelect=(mmc3Control&0x80)==0x80;
-		const bool PRGSelect=(mmc3Control&0x40)==0x40;
+		static void write(const maddr_t /*addr*/, const byte_t value)
+		{
+			select32KROM(value&7);
+			rom::setMirrorMode((value&16)?MIRRORING::HSINGLESCREEN:MIRRORING::LSINGLESCREEN);
+		}
+	};
 
-		switch (mmc3Cmd) // Command Number
+	// the hooks of a board, bound at compile time. the core only reaches them at register writes and at the few
+	// scanline events of a frame, never per instruction, so one call through the table is all they cost.
+	template <class BOARD>
+	static BOARDHOOKS hooksOf(const int type)
+	{
+		BOARDHOOKS hooks={type, BOARD::setup, BOARD::write, BOARD::HBlank, BOARD::nextEventLine, BOARD::skipScanlines};
+		return hooks;
+	}
+
+	// supported boards by mapper number, adding one only takes a line here
+	static const BOARDHOOKS boards[]=
+	{
+		hooksOf<NROM>(0),
+		hooksOf<MMC1>(1),
+		hooksOf<UNROM>(2),
+		hooksOf<CNROM>(3),
+		hooksOf<MMC3>(4),
+		hooksOf<AOROM>(7),
+	};
+
+	// board of the loaded rom, null if it isn't supported
+	static const BOARDHOOKS* findBoard()
+	{
+		for (int i=0;i<(int)(sizeof(boards)/sizeof(boards[0]));i++)
 		{
-		case 0: // Select 2x1K VROM at PPU 0000h-07FFh
-			//assert(0==(mmc3Data&1));
-			//pmapper::selectVROM(2, mmc3Data>>1, CHRSelect?2:0); 
-			pmapper::selectVROM(1, mmc3Data, CHRSelect?4:0);  
-			pmapper::selectVROM(1, mmc3Data+1, CHRSelect?5:1);
-			break;
-		case 1: // Select 2x1K VROM at PPU 0800h-0FFFh
-			//assert(0==(mmc3Data&1));
-			//pmapper::selectVROM(2, mmc3Data>>1, CHRSelect?3:1); 
-			pmapper::selectVROM(1, mmc3Data, CHRSelect?6:2); 
-			pmapper::selectVROM(1, mmc3Data+1, CHRSelect?7:3); 
-			break;
-		case 2: // Select 1K VROM at PPU 1000h-13FFh
-			pmapper::selectVROM(1, mmc3Data, CHRSelect?0:4);
-			break;
-		case 3: // Select 1K VROM at PPU 1400h-17FFh
-			pmapper::selectVROM(1, mmc3Data, CHRSelect?1:5);
-			break;
-		case 4: // Select 1K VROM at PPU 1800h-1BFFh
-			pmapper::selectVROM(1, mmc3Data, CHRSelect?2:6);
-			break;
-		case 5: // Select 1K VROM at PPU 1C00h-1FFFh
-			pmapper::selectVROM(1, mmc3Data, CHRSelect?3:7);
-			break;
-		case 6: // Select 8K ROM at 8000h-9FFFh
-			if (!PRGSelect)
-				mmc::bankSwitch(mmc3Data, INVALID, rom::count8KPRG()-2, rom::count8KPRG()-1);
-			else
-				mmc::bankSwitch(rom::count8KPRG()-2, INVALID, mmc3Data, rom::count8KPRG()-1);
-			break;
-		case 7: // Select 8K ROM at A000h-BFFFh
-			if (!PRGSelect)
-				mmc::bankSwitch(INVALID, mmc3Data, rom::count8KPRG()-2, rom::count8KPRG()-1);
-			else
-				mmc::bankSwitch(rom::count8KPRG()-2, mmc3Data, INVALID, rom::count8KPRG()-1);
-			break;
+			if (boards[i].type==rom::mapperType()) return &boards[i];
 		}
+		return nullptr;
 	}
 
-	bool mmc3Write(const maddr_t addr, const byte_t value)
+	void reset()
 	{
-		switch (valueOf(addr))
+		// MMC1
+		mapperState().mmc1Sel=INVALID;
+		mapperState().mmc1Tmp=0;
+		mapperState().mmc1Pos=0;
+		for (int i=0; i<4; i++)
 		{
-		case 0x8000: // Index/Control (5bit)
-			mmc3Cmd=value&7;
-			mmc3Control=value;
-			return true;
-		case 0x8001: // Data Register
-			mmc3Data=value;
-			mmc3Apply();
-			return true;
-		case 0xA000: // Mirroring Select
-			rom::setMirrorMode((value&1)?MIRRORING::HORIZONTAL:MIRRORING::VERTICAL);
-			return true;
-		case 0xA001: // SaveRAM Toggle
-			mmc::setSRAMEnabled((value&1)==1);
-			return true;
-		case 0xC000: // IRQ Counter Register
-			mmc3Counter=value;
-			return true;
-		case 0xC001: // IRQ Latch Register
-			mmc3Latch=value;
-			return true;
-		case 0xE000: // IRQ Control Register 0
-			mmc3IRQ=false;
-			mmc3Counter=mmc3Latch;
-			return true;
-		case 0xE001: // IRQ Control Register 1
-			mmc3IRQ=true;
-			return true;
+			mapperState().mmc1Regs[i].clearAll();
 		}
-		return false;
+
+		// MMC3
+		mapperState().mmc3Control=INVALID;
+		mapperState().mmc3Cmd=0;
+		mapperState().mmc3Data=0;
+		mapperState().mmc3Counter=0;
+		mapperState().mmc3Latch=INVALID;
+		mapperState().mmc3IRQ=false;
+
+		// without a supported rom the cartridge space acts as if there were no mapper
+		mapperState().board=findBoard();
+		if (mapperState().board==nullptr) mapperState().board=&boards[0];
+		mmc::setRegisterHandler(mapperState().board->write);
+	}
+
+	void load(const SNAPSHOT& s)
+	{
+		// the board stays the one of the loaded rom
+		MAPPERSTATE& state=mapperState();
+		state.mmc1Sel=(ioreg_t)s.mapper.mmc1Sel;
+		state.mmc1Pos=(ioreg_t)s.mapper.mmc1Pos;
+		state.mmc1Tmp=(ioreg_t)s.mapper.mmc1Tmp;
+		for (int i=0;i<4;i++) state.mmc1Regs[i].asBitField()=s.mapper.mmc1Regs[i];
+		state.mmc3Control=(ioreg_t)s.mapper.mmc3Control;
+		state.mmc3Cmd=(ioreg_t)s.mapper.mmc3Cmd;
+		state.mmc3Data=(ioreg_t)s.mapper.mmc3Data;
+		state.mmc3Counter=(ioreg_t)s.mapper.mmc3Counter;
+		state.mmc3Latch=(ioreg_t)s.mapper.mmc3Latch;
+		state.mmc3IRQ=s.mapper.mmc3IRQ!=0;
 	}
 
-	void mmc3HBlank()
+	void save(SNAPSHOT& s)
+	{
+		const MAPPERSTATE& state=mapperState();
+		s.mapper.mmc1Sel=(uint32_t)state.mmc1Sel;
+		s.mapper.mmc1Pos=(uint32_t)state.mmc1Pos;
+		s.mapper.mmc1Tmp=(uint32_t)state.mmc1Tmp;
+		for (int i=0;i<4;i++) s.mapper.mmc1Regs[i]=(uint8_t)valueOf(state.mmc1Regs[i]);
+		s.mapper.mmc3Control=(uint32_t)state.mmc3Control;
+		s.mapper.mmc3Cmd=(uint32_t)state.mmc3Cmd;
+		s.mapper.mmc3Data=(uint32_t)state.mmc3Data;
+		s.mapper.mmc3Counter=(uint32_t)state.mmc3Counter;
+		s.mapper.mmc3Latch=(uint32_t)state.mmc3Latch;
+		s.mapper.mmc3IRQ=state.mmc3IRQ?1:0;
+		memset(s.mapper.reserved, 0, sizeof(s.mapper.reserved));
+	}
+
+	bool setup()
 	{
-		if (ppu::currentScanline()==-1)
-			mmc3Counter=mmc3Latch;
-		else if (ppu::currentScanline()>=0 && ppu::currentScanline()<=239)
+		mapperState().board=findBoard();
+		if (mapperState().board==nullptr)
 		{
-			if (mmc3IRQ && render::enabled())
-			{
-				mmc3Counter=(mmc3Counter-1)&0xFF;
-				if (!mmc3Counter)
-				{
-					cpu::irq(IRQTYPE::IRQ);
-				}
-			}
+			// unknown mapper
+			FATAL_ERROR(INVALID_ROM, UNSUPPORTED_MAPPER_TYPE, "mapper", rom::mapperType());
+			mapperState().board=&boards[0];
+			return false;
 		}
+		mmc::setRegisterHandler(mapperState().board->write);
+		return mapperState().board->setup();
+	}
+
+	void HBlank()
+	{
+		mapperState().board->HBlank();
+	}
+
+	// first scanline from the given one on whose HBlank() has to be run, NO_EVENT if none this frame
+	int nextEventLine(const int scanline)
+	{
+		return mapperState().board->nextEventLine(scanline);
+	}
+
+	// count scanlines pass without an HBlank() each, none of them being an event line
+	void skipScanlines(const int scanline, const int count)
+	{
+		mapperState().board->skipScanlines(scanline, count);
 	}
 }
 
@@ -648,10 +776,51 @@ public:
 	virtual TestResult run()
 	{
 		puts("checking RAM struture...");
-		tassert(sizeof(ram)==0x10000);
-		tassert(ptr_diff(&ram.bank6[0],&ramData(0))==0x6000);
-		tassert(ptr_diff(ram.page(0x80),&ramData(0))==0x8000);
-		tassert(&ram.code[0]+sizeof(ram.code)==&ramData(0)+sizeof(ram));
+		tassert(ptr_diff(&emu::ram().bank6[0],&emu::ram())==0x6000);
+		tassert(ptr_diff(emu::ram().page(0x60),&emu::ram())==0x6000);
+		tassert(emu::ram().page(0x80)==emu::ram().prg[0] && emu::ram().page(0xFF)==emu::ram().prg[3]+0x1F00);
+
+		// prg-rom banks are mapped in place
+		emu::Machine* m=new emu::Machine();
+		{
+			emu::MachineScope scope(m);
+			m->rom.prgCount=2;
+			m->rom.imageSize=0x8000;
+			m->rom.imageData=new char[0x8000];
+			for (int i=0;i<4;i++)
+				memset(m->rom.imageData+i*0x2000, i, 0x2000);
+
+			tassert(mmc::read(maddr_t(0x8000))==0);
+			mmc::bankSwitch(0, 1, 2, 3);
+			tassert(mmc::read(maddr_t(0xA123))==1 && mmc::read(maddr_t(0xFFFF))==3);
+			mmc::bankSwitch(3, INVALID, 0, INVALID);
+			tassert(emu::ram().prg[0]==(const uint8_t*)m->rom.imageData+0x6000);
+			tassert(mmc::read(maddr_t(0x8000))==3 && mmc::read(maddr_t(0xA000))==1 && mmc::read(maddr_t(0xC000))==0);
+			tassert(m->mmc.pages[0x81].read==emu::ram().prg[0]+0x100);
+
+			// ram and sram pages are written directly, ram through its mirrors
+			mmc::write(maddr_t(0x1810), 0x5A);
+			mmc::write(maddr_t(0x7FFF), 0xA5);
+			tassert(emu::ram().bank0[0x10]==0x5A && mmc::read(maddr_t(0x0810))==0x5A && emu::ram().bank6[0x1FFF]==0xA5);
+
+			// zero page pointers wrap around
+			emu::ram().bank0[0xFF]=0x34;
+			emu::ram().bank0[0x00]=0x12;
+			tassert(mmc::loadZPWord(maddr8_t(0xFF))==0x1234);
+
+			// the mapper's register handler takes the writes to prg-rom
+			m->rom.mapper=7;
+			mapper::reset();
+			mmc::write(maddr_t(0x8000), 0);
+			tassert(mmc::read(maddr_t(0x8000))==0 && mmc::read(maddr_t(0xE000))==3);
+			tassert(m->mapper.board->type==7 && m->mapper.board->HBlank!=nullptr);
+
+			// an unsupported mapper leaves the board without registers
+			m->rom.mapper=5;
+			mapper::reset();
+			tassert(m->mapper.board->type==0);
+		}
+		delete m;
 
 		// mapper test
 		tassert(mapper::maskPRG(0,4)==0);
@@ -670,7 +839,7 @@ public:
 		tassert(pmapper::maskCHR(6,7)==6);
 		tassert(pmapper::maskCHR(32,16)==0);
 
-		printf("[ ] System memory at 0x%p\n", &ram);
+		printf("[ ] System memory at 0x%p\n", &emu::ram());
 		return SUCCESS;
 	}
 };
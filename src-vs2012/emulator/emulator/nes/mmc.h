@@ -25,39 +25,36 @@ public:
 	// $6000 SaveRAM
 	uint8_t bank6[8192];
 
-	union
-	{
-		uint8_t code[0x8000];
-
-		struct
-		{
-			// $8000 PRG-ROM (8K per bank, 4 built-in banks)
-			uint8_t bank8[8192], bankA[8192];
-
-			// $C000 Can be mirror of PRG-ROM at $8000
-			uint8_t bankC[8192], bankE[8192];
-		};
-	};
+	// $8000 PRG-ROM, 8K per bank, pointing straight into the rom image
+	// (bank8, bankA, bankC, bankE; $C000 can be a mirror of $8000)
+	const uint8_t* prg[4];
 
 public:
-	inline uint8_t& data(const size_t ptr)
+	// byte at a cpu address in ram or prg-rom
+	inline uint8_t data(const size_t ptr) const
 	{
 		vassert(ptr<0x800 || ptr>=0x6000);
-		return ((uint8_t*)this)[ptr];
+		if (ptr>=0x8000) return prg[(ptr>>13)&3][ptr&0x1FFF];
+		return ((const uint8_t*)this)[ptr];
 	}
 
-	inline uint8_t* page(const size_t num)
+	inline const uint8_t* page(const size_t num) const
 	{
 		vassert(num<0x8 || num>=0x60);
-		return &((uint8_t*)this)[num<<8];
+		if (num>=0x80) return &prg[(num>>5)&3][(num&0x1F)<<8];
+		return &((const uint8_t*)this)[num<<8];
 	}
 };
 
-extern struct NESRAM ram;
-#define ramSt ram.stack
-#define ram0p ram.zeropage
-#define ramPg(num) ram.page(num)
-#define ramData(offset) ram.data(offset)
+#define ramSt emu::ram().stack
+#define ram0p emu::ram().zeropage
+#define ramPg(num) emu::ram().page(num)
+#define ramData(offset) emu::ram().data(offset)
+
+struct SNAPSHOT;
+
+typedef byte_t (*READHANDLER)(const maddr_t addr);
+typedef void (*WRITEHANDLER)(const maddr_t addr, const byte_t value);
 
 namespace mmc
 {
@@ -66,40 +63,39 @@ namespace mmc
 
 	void bankSwitch(int reg8, int regA, int regC, int regE);
 
-	extern __forceinline opcode_t fetchOpcode(maddr_t& pc);
-	extern __forceinline maddr8_t fetchByteOperand(maddr_t& pc);
-	extern __forceinline maddr_t fetchWordOperand(maddr_t& pc);
-	extern __forceinline byte_t loadZPByte(const maddr8_t zp);
-	extern __forceinline word_t loadZPWord(const maddr8_t zp);
+	extern EXTERN_INLINE opcode_t fetchOpcode(maddr_t& pc);
+	extern EXTERN_INLINE maddr8_t fetchByteOperand(maddr_t& pc);
+	extern EXTERN_INLINE maddr_t fetchWordOperand(maddr_t& pc);
+	extern EXTERN_INLINE byte_t loadZPByte(const maddr8_t zp);
+	extern EXTERN_INLINE word_t loadZPWord(const maddr8_t zp);
 
 	byte_t read(const maddr_t addr);
 	void write(const maddr_t addr, const byte_t value);
+	void setRegisterHandler(WRITEHANDLER handler);
 
 	// save state
-	void save(FILE *fp);
-	void load(FILE *fp);
+	void save(SNAPSHOT& s);
+	void load(const SNAPSHOT& s);
 }
 
 namespace mapper
 {
+	// nextEventLine() when no scanline needs the mapper this frame
+	const int NO_EVENT=0x7FFFFFFF;
+
 	// global functions
 	void reset();
 	bool setup();
 
-	bool write(const maddr_t addr, const byte_t value);
-
 	void HBlank();
-
-	bool mmc1Write(const maddr_t addr, const byte_t value);
-	bool mmc3Write(const maddr_t addr, const byte_t value);
-
-	void mmc3HBlank();
+	int nextEventLine(const int scanline);
+	void skipScanlines(const int scanline, const int count);
 
 	byte_t maskPRG(byte_t bank, const byte_t count);
 
 	// save state
-	void save(FILE *fp);
-	void load(FILE *fp);
+	void save(SNAPSHOT& s);
+	void load(const SNAPSHOT& s);
 }
 
 enum class MMC1REG
@@ -110,4 +106,56 @@ enum class MMC1REG
 	PRG_BANK=0xF,
 
 	MASK=0x1F
+};
+
+// how the cpu reaches one 256-byte page of its address space
+struct MEMPAGE
+{
+	const uint8_t* read; // memory read straight from, null if readHandler does it
+	uint8_t* write; // memory written straight to, null if writeHandler does it
+	READHANDLER readHandler;
+	WRITEHANDLER writeHandler;
+};
+
+// bank-switching state of the memory controller
+struct MMCSTATE
+{
+	// addresses of currently selected prg-rom banks.
+	int p8, pA, pC, pE;
+
+	bool sramEnabled;
+
+	// cpu address space by page, ram and prg-rom are accessed directly
+	MEMPAGE pages[0x100];
+};
+
+// hooks of a cartridge board, see mapper::Board
+struct BOARDHOOKS
+{
+	int type; // mapper number
+	bool (*setup)();
+	WRITEHANDLER write;
+	void (*HBlank)();
+	int (*nextEventLine)(const int scanline);
+	void (*skipScanlines)(const int scanline, const int count);
+};
+
+// registers of the cartridge mapper
+struct MAPPERSTATE
+{
+	const BOARDHOOKS* board;
+
+	// MMC1 registers
+	ioreg_t mmc1Sel; // register select
+	ioreg_t mmc1Pos;
+	ioreg_t mmc1Tmp;
+	flag_set<ioreg_t, MMC1REG, 5> mmc1Regs[4];
+
+	// MMC3 registers
+	ioreg_t mmc3Control;
+	ioreg_t mmc3Cmd;
+	ioreg_t mmc3Data;
+	ioreg_t mmc3Counter;
+	ioreg_t mmc3Latch;
+	bool mmc3IRQ;
 };
\ No newline at end of file
@@ -0,0 +1,266 @@
+// legal 6502 opcodes: OPCODE(instruction, opcode, addressing mode, size in bytes, cycles)
+// define OPCODE before including this file
+
+// ADC:
+OPCODE(INS_ADC,0x69,ADR_IMM,2,2)
+OPCODE(INS_ADC,0x65,ADR_ZP,2,3)
+OPCODE(INS_ADC,0x75,ADR_ZPX,2,4)
+OPCODE(INS_ADC,0x6D,ADR_ABS,3,4)
+OPCODE(INS_ADC,0x7D,ADR_ABSX,3,4)
+OPCODE(INS_ADC,0x79,ADR_ABSY,3,4)
+OPCODE(INS_ADC,0x61,ADR_PREIDXIND,2,6)
+OPCODE(INS_ADC,0x71,ADR_POSTIDXIND,2,5)
+
+// AND:
+OPCODE(INS_AND,0x29,ADR_IMM,2,2)
+OPCODE(INS_AND,0x25,ADR_ZP,2,3)
+OPCODE(INS_AND,0x35,ADR_ZPX,2,4)
+OPCODE(INS_AND,0x2D,ADR_ABS,3,4)
+OPCODE(INS_AND,0x3D,ADR_ABSX,3,4)
+OPCODE(INS_AND,0x39,ADR_ABSY,3,4)
+OPCODE(INS_AND,0x21,ADR_PREIDXIND,2,6)
+OPCODE(INS_AND,0x31,ADR_POSTIDXIND,2,5)
+
+// ASL:
+OPCODE(INS_ASLA,0x0A,ADR_ACC,1,2)
+OPCODE(INS_ASL,0x06,ADR_ZP,2,5)
+OPCODE(INS_ASL,0x16,ADR_ZPX,2,6)
+OPCODE(INS_ASL,0x0E,ADR_ABS,3,6)
+OPCODE(INS_ASL,0x1E,ADR_ABSX,3,7)
+
+// BCC:
+OPCODE(INS_BCC,0x90,ADR_REL,2,2)
+
+// BCS:
+OPCODE(INS_BCS,0xB0,ADR_REL,2,2)
+
+// BEQ:
+OPCODE(INS_BEQ,0xF0,ADR_REL,2,2)
+
+// BIT:
+OPCODE(INS_BIT,0x24,ADR_ZP,2,3)
+OPCODE(INS_BIT,0x2C,ADR_ABS,3,4)
+
+// BMI:
+OPCODE(INS_BMI,0x30,ADR_REL,2,2)
+
+// BNE:
+OPCODE(INS_BNE,0xD0,ADR_REL,2,2)
+
+// BPL:
+OPCODE(INS_BPL,0x10,ADR_REL,2,2)
+
+// BRK:
+OPCODE(INS_BRK,0x00,ADR_IMP,1,7)
+
+// BVC:
+OPCODE(INS_BVC,0x50,ADR_REL,2,2)
+
+// BVS:
+OPCODE(INS_BVS,0x70,ADR_REL,2,2)
+
+// CLC:
+OPCODE(INS_CLC,0x18,ADR_IMP,1,2)
+
+// CLD:
+OPCODE(INS_CLD,0xD8,ADR_IMP,1,2)
+
+// CLI:
+OPCODE(INS_CLI,0x58,ADR_IMP,1,2)
+
+// CLV:
+OPCODE(INS_CLV,0xB8,ADR_IMP,1,2)
+
+// CMP:
+OPCODE(INS_CMP,0xC9,ADR_IMM,2,2)
+OPCODE(INS_CMP,0xC5,ADR_ZP,2,3)
+OPCODE(INS_CMP,0xD5,ADR_ZPX,2,4)
+OPCODE(INS_CMP,0xCD,ADR_ABS,3,4)
+OPCODE(INS_CMP,0xDD,ADR_ABSX,3,4)
+OPCODE(INS_CMP,0xD9,ADR_ABSY,3,4)
+OPCODE(INS_CMP,0xC1,ADR_PREIDXIND,2,6)
+OPCODE(INS_CMP,0xD1,ADR_POSTIDXIND,2,5)
+
+// CPX:
+OPCODE(INS_CPX,0xE0,ADR_IMM,2,2)
+OPCODE(INS_CPX,0xE4,ADR_ZP,2,3)
+OPCODE(INS_CPX,0xEC,ADR_ABS,3,4)
+
+// CPY:
+OPCODE(INS_CPY,0xC0,ADR_IMM,2,2)
+OPCODE(INS_CPY,0xC4,ADR_ZP,2,3)
+OPCODE(INS_CPY,0xCC,ADR_ABS,3,4)
+
+// DEC:
+OPCODE(INS_DEC,0xC6,ADR_ZP,2,5)
+OPCODE(INS_DEC,0xD6,ADR_ZPX,2,6)
+OPCODE(INS_DEC,0xCE,ADR_ABS,3,6)
+OPCODE(INS_DEC,0xDE,ADR_ABSX,3,7)
+
+// DEX:
+OPCODE(INS_DEX,0xCA,ADR_IMP,1,2)
+
+// DEY:
+OPCODE(INS_DEY,0x88,ADR_IMP,1,2)
+
+// EOR:
+OPCODE(INS_EOR,0x49,ADR_IMM,2,2)
+OPCODE(INS_EOR,0x45,ADR_ZP,2,3)
+OPCODE(INS_EOR,0x55,ADR_ZPX,2,4)
+OPCODE(INS_EOR,0x4D,ADR_ABS,3,4)
+OPCODE(INS_EOR,0x5D,ADR_ABSX,3,4)
+OPCODE(INS_EOR,0x59,ADR_ABSY,3,4)
+OPCODE(INS_EOR,0x41,ADR_PREIDXIND,2,6)
+OPCODE(INS_EOR,0x51,ADR_POSTIDXIND,2,5)
+
+// INC:
+OPCODE(INS_INC,0xE6,ADR_ZP,2,5)
+OPCODE(INS_INC,0xF6,ADR_ZPX,2,6)
+OPCODE(INS_INC,0xEE,ADR_ABS,3,6)
+OPCODE(INS_INC,0xFE,ADR_ABSX,3,7)
+
+// INX:
+OPCODE(INS_INX,0xE8,ADR_IMP,1,2)
+
+// INY:
+OPCODE(INS_INY,0xC8,ADR_IMP,1,2)
+
+// JMP:
+OPCODE(INS_JMP,0x4C,ADR_ABS,3,3)
+OPCODE(INS_JMP,0x6C,ADR_IND/*ABS*/,3,5)
+
+// JSR:
+OPCODE(INS_JSR,0x20,ADR_ABS,3,6)
+
+// LDA:
+OPCODE(INS_LDA,0xA9,ADR_IMM,2,2)
+OPCODE(INS_LDA,0xA5,ADR_ZP,2,3)
+OPCODE(INS_LDA,0xB5,ADR_ZPX,2,4)
+OPCODE(INS_LDA,0xAD,ADR_ABS,3,4)
+OPCODE(INS_LDA,0xBD,ADR_ABSX,3,4)
+OPCODE(INS_LDA,0xB9,ADR_ABSY,3,4)
+OPCODE(INS_LDA,0xA1,ADR_PREIDXIND,2,6)
+OPCODE(INS_LDA,0xB1,ADR_POSTIDXIND,2,5)
+
+
+// LDX:
+OPCODE(INS_LDX,0xA2,ADR_IMM,2,2)
+OPCODE(INS_LDX,0xA6,ADR_ZP,2,3)
+OPCODE(INS_LDX,0xB6,ADR_ZPY,2,4)
+OPCODE(INS_LDX,0xAE,ADR_ABS,3,4)
+OPCODE(INS_LDX,0xBE,ADR_ABSY,3,4)
+
+// LDY:
+OPCODE(INS_LDY,0xA0,ADR_IMM,2,2)
+OPCODE(INS_LDY,0xA4,ADR_ZP,2,3)
+OPCODE(INS_LDY,0xB4,ADR_ZPX,2,4)
+OPCODE(INS_LDY,0xAC,ADR_ABS,3,4)
+OPCODE(INS_LDY,0xBC,ADR_ABSX,3,4)
+
+// LSR:
+OPCODE(INS_LSRA,0x4A,ADR_ACC,1,2)
+OPCODE(INS_LSR,0x46,ADR_ZP,2,5)
+OPCODE(INS_LSR,0x56,ADR_ZPX,2,6)
+OPCODE(INS_LSR,0x4E,ADR_ABS,3,6)
+OPCODE(INS_LSR,0x5E,ADR_ABSX,3,7)
+
+// NOP:
+OPCODE(INS_NOP,0xEA,ADR_IMP,1,2)
+
+// ORA:
+OPCODE(INS_ORA,0x09,ADR_IMM,2,2)
+OPCODE(INS_ORA,0x05,ADR_ZP,2,3)
+OPCODE(INS_ORA,0x15,ADR_ZPX,2,4)
+OPCODE(INS_ORA,0x0D,ADR_ABS,3,4)
+OPCODE(INS_ORA,0x1D,ADR_ABSX,3,4)
+OPCODE(INS_ORA,0x19,ADR_ABSY,3,4)
+OPCODE(INS_ORA,0x01,ADR_PREIDXIND,2,6)
+OPCODE(INS_ORA,0x11,ADR_POSTIDXIND,2,5)
+
+// PHA:
+OPCODE(INS_PHA,0x48,ADR_IMP,1,3)
+
+// PHP:
+OPCODE(INS_PHP,0x08,ADR_IMP,1,3)
+
+// PLA:
+OPCODE(INS_PLA,0x68,ADR_IMP,1,4)
+
+// PLP:
+OPCODE(INS_PLP,0x28,ADR_IMP,1,4)
+
+// ROL:
+OPCODE(INS_ROLA,0x2A,ADR_ACC,1,2)
+OPCODE(INS_ROL,0x26,ADR_ZP,2,5)
+OPCODE(INS_ROL,0x36,ADR_ZPX,2,6)
+OPCODE(INS_ROL,0x2E,ADR_ABS,3,6)
+OPCODE(INS_ROL,0x3E,ADR_ABSX,3,7)
+
+// ROR:
+OPCODE(INS_RORA,0x6A,ADR_ACC,1,2)
+OPCODE(INS_ROR,0x66,ADR_ZP,2,5)
+OPCODE(INS_ROR,0x76,ADR_ZPX,2,6)
+OPCODE(INS_ROR,0x6E,ADR_ABS,3,6)
+OPCODE(INS_ROR,0x7E,ADR_ABSX,3,7)
+
+// RTI:
+OPCODE(INS_RTI,0x40,ADR_IMP,1,6)
+
+// RTS:
+OPCODE(INS_RTS,0x60,ADR_IMP,1,6)
+
+// SBC:
+OPCODE(INS_SBC,0xE9,ADR_IMM,2,2)
+OPCODE(INS_SBC,0xE5,ADR_ZP,2,3)
+OPCODE(INS_SBC,0xF5,ADR_ZPX,2,4)
+OPCODE(INS_SBC,0xED,ADR_ABS,3,4)
+OPCODE(INS_SBC,0xFD,ADR_ABSX,3,4)
+OPCODE(INS_SBC,0xF9,ADR_ABSY,3,4)
+OPCODE(INS_SBC,0xE1,ADR_PREIDXIND,2,6)
+OPCODE(INS_SBC,0xF1,ADR_POSTIDXIND,2,5)
+
+// SEC:
+OPCODE(INS_SEC,0x38,ADR_IMP,1,2)
+
+// SED:
+OPCODE(INS_SED,0xF8,ADR_IMP,1,2)
+
+// SEI:
+OPCODE(INS_SEI,0x78,ADR_IMP,1,2)
+
+// STA:
+OPCODE(INS_STA,0x85,ADR_ZP,2,3)
+OPCODE(INS_STA,0x95,ADR_ZPX,2,4)
+OPCODE(INS_STA,0x8D,ADR_ABS,3,4)
+OPCODE(INS_STA,0x9D,ADR_ABSX,3,5)
+OPCODE(INS_STA,0x99,ADR_ABSY,3,5)
+OPCODE(INS_STA,0x81,ADR_PREIDXIND,2,6)
+OPCODE(INS_STA,0x91,ADR_POSTIDXIND,2,6)
+
+// STX:
+OPCODE(INS_STX,0x86,ADR_ZP,2,3)
+OPCODE(INS_STX,0x96,ADR_ZPY,2,4)
+OPCODE(INS_STX,0x8E,ADR_ABS,3,4)
+
+// STY:
+OPCODE(INS_STY,0x84,ADR_ZP,2,3)
+OPCODE(INS_STY,0x94,ADR_ZPX,2,4)
+OPCODE(INS_STY,0x8C,ADR_ABS,3,4)
+
+// TAX:
+OPCODE(INS_TAX,0xAA,ADR_IMP,1,2)
+
+// TAY:
+OPCODE(INS_TAY,0xA8,ADR_IMP,1,2)
+
+// TSX:
+OPCODE(INS_TSX,0xBA,ADR_IMP,1,2)
+
+// TXA:
+OPCODE(INS_TXA,0x8A,ADR_IMP,1,2)
+
+// TXS:
+OPCODE(INS_TXS,0x9A,ADR_IMP,1,2)
+
+// TYA:
+OPCODE(INS_TYA,0x98,ADR_IMP,1,2)
@@ -108,11 +108,9 @@ struct M6502_OPCODE
 // global functions
 namespace opcode
 {
-	void initTable();
-
-	extern __forceinline M6502_OPCODE decode(const opcode_t opcode);
-	extern __forceinline const char* instName(const M6502_INST inst);
-	extern __forceinline const char* instName(const opcode_t opcode);
-	extern __forceinline const char* explainAddrMode(const M6502_ADDRMODE adrmode);
-	extern __forceinline bool usual(const opcode_t opcode);
+	extern EXTERN_INLINE M6502_OPCODE decode(const opcode_t opcode);
+	extern EXTERN_INLINE const char* instName(const M6502_INST inst);
+	extern EXTERN_INLINE const char* instName(const opcode_t opcode);
+	extern EXTERN_INLINE const char* explainAddrMode(const M6502_ADDRMODE adrmode);
+	extern EXTERN_INLINE bool usual(const opcode_t opcode);
 }
\ No newline at end of file
@@ -12,160 +12,166 @@
 #include "ppu.h"
 #include "mmc.h"
 #include "emu.h"
+#include "testrom.h"
 
-// PPU Memory
-__declspec(align(0x1000))
-struct NESVRAM vram;
-struct NESOAM oam;
-
-// PPU Control & Status Registers
-static flag_set<_reg8_t, PPUCTRL, 8> control; // $2000
-static flag_set<_reg8_t, PPUMASK, 8> mask; // $2001
-static flag_set<_reg8_t, PPUSTATUS, 8> status; // $2002
-#define control1 control
-#define control2 mask
-
-// PPU SPR-RAM Access Registers
-static saddr_t oamAddr; // $2003
-
-// PPU VRAM Access Registers
-typedef flag_set<_addr15_t, PPUADDR, 15> scroll_flag_t;
-typedef flag_set<_addr14_t, PPUADDR, 14> vaddr_flag_t;
-static scroll_flag_t scroll; // $2005 Background Scrolling Offset / Reload register
-static offset3_t xoffset;
-static vaddr_flag_t address; // $2006 VRAM Address Register / Scrolling Pointer
-static vaddr_flag_t tmpAddress; // debug only
-#define address1 address
-#define address2 scroll
-#define scrollptr address
-#define scrollrld scroll
-
-// PPU counters
-static int scanline;
-static long long frameNum;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+	#define WANT_SSE2
+	#include <emmintrin.h>
+#endif
+// pshufb needs no build flags: its code is built for SSSE3 alone and only runs where cpuid reports it
+#if defined(WANT_SSE2) && (defined(_MSC_VER) || defined(__GNUC__))
+	#define WANT_SSSE3
+	#include <tmmintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define TARGET_SSSE3
+	#else
+		#define TARGET_SSSE3 __attribute__((target("ssse3")))
+	#endif
+#endif
 
-namespace mem
+// PPU registers and counters (owned by the active machine)
+static FORCE_INLINE PPUSTATE& ppuState()
 {
-	// addresses of currently selected VROM banks.
-	static int prevBankSrc[8];
+	return emu::active().ppu;
+}
 
-	// shared for both port $2005 and $2006
-	static bool firstWrite;
-	// $2007 Read/Write Data Register
-	static byte_t latch;
-	
+// frame buffers and work area of the renderer (owned by the active machine)
+static FORCE_INLINE RENDERSTATE& renderState()
+{
+	return emu::active().render;
+}
+
+namespace mem
+{
 	static void resetToggle()
 	{
-		firstWrite=true;
-		latch=INVALID;
+		ppuState().firstWrite=true;
+		ppuState().latch=INVALID;
 	}
 
 	static bool toggle()
 	{
-		const bool ret=firstWrite;
-		firstWrite=!firstWrite;
+		const bool ret=ppuState().firstWrite;
+		ppuState().firstWrite=!ppuState().firstWrite;
 		return ret;
 	}
 
+	static void invalidateTiles()
+	{
+		for (int i=0;i<8;i++)
+		{
+			renderState().tileCache[i].source=nullptr;
+		}
+	}
+
 	static void reset()
 	{
 		// reset bank-switching state
-		memset(prevBankSrc, -1, sizeof(prevBankSrc));
+		memset(ppuState().prevBankSrc, -1, sizeof(ppuState().prevBankSrc));
+		invalidateTiles();
 
 		// clear memory
-		memset(&vram,0,sizeof(vram));
-		memset(&oam,0,sizeof(oam));
+		memset(&emu::vram(),0,sizeof(emu::vram()));
+		memset(&emu::oam(),0,sizeof(emu::oam()));
+
+		// pattern tables are backed by vram until a CHR-ROM bank is mapped
+		for (int i=0;i<8;i++)
+		{
+			ppuState().chrPages[i]=&vramData(i*0x400);
+		}
 	}
 
-	static void copyBanks(const int dest, const int src, const int count)
+	static void mapBanks(const int dest, const int src, const int count)
 	{
 		assert((dest+count)*0x400<=0x2000);
 		assert((src+count)*0x400<=(int)rom::sizeOfVROM());
-		memcpy(&vramData(dest*0x400), rom::getVROM()+src*0x400, count*0x400);
+		for (int i=0;i<count;i++)
+		{
+			ppuState().chrPages[dest+i]=(const uint8_t*)rom::getVROM()+(src+i)*0x400;
+		}
 	}
 
 	void bankSwitch(const int dest, const int src, const int count)
 	{
 		assert(dest>=0 && dest+count<=8);
 		assert(src!=INVALID && src>=0);
+		ppu::catchUp();
 		for (int i=0; i<count; i++)
 		{
-			if (prevBankSrc[dest+i]!=src+i)
+			if (ppuState().prevBankSrc[dest+i]!=src+i)
 			{
-				prevBankSrc[dest+i]=src+i;
-				copyBanks(dest+i, src+i, 1);
+				ppuState().prevBankSrc[dest+i]=src+i;
+				mapBanks(dest+i, src+i, 1);
 			}
 		}
 	}
 	
-	static bool saveCompleteMemory()
+	static void save(SNAPSHOT& s)
 	{
-#ifdef SAVE_COMPLETE_MEMORY
-		return true;
-#else
-		// force complete memory dump when CHR banks don't exist in the rom.
-		return (rom::count8KCHR() == 0);
-#endif
+		STATIC_ASSERT(sizeof(s.ppuRam)==sizeof(NESVRAM) && sizeof(s.spriteRam)==sizeof(NESOAM));
+		memcpy(s.ppuRam, &vramData(0), sizeof(s.ppuRam));
+		memcpy(s.spriteRam, &oamData(0), sizeof(s.spriteRam));
 	}
 
-	static void save(FILE *fp)
+	static void load(const SNAPSHOT& s)
 	{
-		// memory
-		if (saveCompleteMemory())
-		{
-			fwrite(&vram, sizeof(vram), 1, fp);
-		}else
+		memcpy(&vramData(0), s.ppuRam, sizeof(s.ppuRam));
+		memcpy(&oamData(0), s.spriteRam, sizeof(s.spriteRam));
+
+		// pages point into this machine's vram or vrom
+		for (int i=0;i<8;i++)
 		{
-			// skip vrom
-			fwrite(&vram.nameTables, sizeof(vram.nameTables), 1, fp);
-			fwrite(&vram.pal, sizeof(vram.pal), 1, fp);
+			if (rom::count8KCHR()==0 || ppuState().prevBankSrc[i]<0)
+				ppuState().chrPages[i]=&vramData(i*0x400);
+			else
+				mapBanks(i, ppuState().prevBankSrc[i], 1);
 		}
-		fwrite(&oam, sizeof(oam), 1, fp);
-		
-		// toggle
-		fwrite(&firstWrite, sizeof(firstWrite), 1, fp);
-
-		// latch
-		fwrite(&latch, sizeof(latch), 1, fp);
+		invalidateTiles();
+	}
 
-		// bank-switching state
-		fwrite(prevBankSrc, sizeof(prevBankSrc), 1, fp);
+	// pattern data of a tile in the specified pattern table
+	static const NESVRAM::VROM::PATTERN_TABLE::PATTERN* patternTile(const int table, const int tileIndex)
+	{
+		const int index=(table<<8)|tileIndex;
+		return (const NESVRAM::VROM::PATTERN_TABLE::PATTERN*)(ppuState().chrPages[index>>6]+((index&63)<<4));
 	}
 
-	static void load(FILE *fp)
+	static void decodePage(const int page)
 	{
-		// memory
-		if (saveCompleteMemory())
-		{
-			fread(&vram, sizeof(vram), 1, fp);
-		}else
+		DECODEDCHR& cache=renderState().tileCache[page];
+		const NESVRAM::VROM::PATTERN_TABLE::PATTERN* tiles=(const NESVRAM::VROM::PATTERN_TABLE::PATTERN*)ppuState().chrPages[page];
+		for (int tile=0;tile<64;tile++)
 		{
-			// skip vrom
-			fread(&vram.nameTables, sizeof(vram.nameTables), 1, fp);
-			fread(&vram.pal, sizeof(vram.pal), 1, fp);
+			for (int row=0;row<8;row++)
+			{
+				const byte_t colorD0=tiles[tile].colorD0[row];
+				const byte_t colorD1=tiles[tile].colorD1[row];
+				uint16_t normal=0, flipped=0;
+				for (int x=0;x<8;x++)
+				{
+					// Note: B7 holds the leftmost pixel of the tile
+					const int colorD0D1=((colorD0>>(7-x))&1)|(((colorD1>>(7-x))<<1)&2);
+					normal|=colorD0D1<<(x<<1);
+					flipped|=colorD0D1<<((7-x)<<1);
+				}
+				cache.rows[0][tile][row]=normal;
+				cache.rows[1][tile][row]=flipped;
+			}
 		}
-		fread(&oam, sizeof(oam), 1, fp);
-
-		// toggle
-		fread(&firstWrite, sizeof(firstWrite), 1, fp);
-
-		// latch
-		fread(&latch, sizeof(latch), 1, fp);
+		cache.source=ppuState().chrPages[page];
+	}
 
-		// bank-switching state
-		if (saveCompleteMemory())
-		{
-			fread(prevBankSrc, sizeof(prevBankSrc), 1, fp);
-		}else
+	// decoded pattern rows of a tile in the specified pattern table
+	static const uint16_t* decodedTile(const int table, const int tileIndex, const bool flipH=false)
+	{
+		const int index=(table<<8)|tileIndex;
+		if (renderState().tileCache[index>>6].source!=ppuState().chrPages[index>>6])
 		{
-			int bankSrc[8];
-			STATIC_ASSERT(sizeof(bankSrc) == sizeof(prevBankSrc));
-			fread(bankSrc, sizeof(bankSrc), 1, fp);
-			for (int i=0;i<8;i++)
-			{
-				bankSwitch(i, bankSrc[i], 1);
-			}
+			// bank switched or chr-ram modified since the last decode
+			decodePage(index>>6);
 		}
+		return renderState().tileCache[index>>6].rows[flipH?1:0][index&63];
 	}
 
 	static vaddr_t ntMirror(vaddr_flag_t vaddr)
@@ -192,7 +198,7 @@ namespace mem
 
 	static vaddr_t mirror(vaddr_flag_t vaddr, bool forRead=true)
 	{
-		assert(address.mask(PPUADDR::UNUSED)==0);
+		assert(ppuState().address.select(PPUADDR::UNUSED)==0);
 		switch (vaddr.select(PPUADDR::BANK))
 		{
 		case 0:
@@ -234,49 +240,49 @@ namespace mem
 
 	static void incAddress()
 	{
-		assert(address.mask(PPUADDR::UNUSED)==0);
-		address.asBitField()+=control[PPUCTRL::VERTICAL_WRITE]?32:1;
+		assert(ppuState().address.select(PPUADDR::UNUSED)==0);
+		ppuState().address.asBitField()+=ppuState().control[PPUCTRL::VERTICAL_WRITE]?32:1;
 	}
 
 	static void setAddress(const byte_t byte) // $2006
 	{
-		if (firstWrite) // higher 6 bits
+		if (ppuState().firstWrite) // higher 6 bits
 		{
 			//vassert((byte&~0x3F)==0);
-			tmpAddress.update<PPUADDR::HIGH_BYTE>(byte&0x3F);
+			ppuState().tmpAddress.update<PPUADDR::HIGH_BYTE>(byte&0x3F);
 
 			// store in Reload register temporarily
-			address2.copy<PPUADDR::FIRST_WRITE_LO, 0, 2>(byte);
-			control.copy<PPUCTRL::CURRENT_NT, 2, 2>(byte);
-			address2.copy<PPUADDR::FIRST_WRITE_HI, 4, 2>(byte);
+			ppuState().scroll.copy<PPUADDR::FIRST_WRITE_LO, 0, 2>(byte);
+			ppuState().control.copy<PPUCTRL::CURRENT_NT, 2, 2>(byte);
+			ppuState().scroll.copy<PPUADDR::FIRST_WRITE_HI, 4, 2>(byte);
 		}else // lower 8 bits
 		{
-			tmpAddress.update<PPUADDR::LOW_BYTE>(byte);
+			ppuState().tmpAddress.update<PPUADDR::LOW_BYTE>(byte);
 			
 			{
 				// ?
-				address2.update<PPUADDR::LOW_BYTE>(byte);
+				ppuState().scroll.update<PPUADDR::LOW_BYTE>(byte);
 			}
-			address1.update<PPUADDR::LOW_BYTE>(byte);
-			address1.update<PPUADDR::FIRST_WRITE_LO>(address2.select(PPUADDR::FIRST_WRITE_LO));
-			address1.update<PPUADDR::FIRST_WRITE_MID>(control.select(PPUCTRL::CURRENT_NT));
-			address1.update<PPUADDR::FIRST_WRITE_HI>(address2.select(PPUADDR::FIRST_WRITE_HI));
-			address1.asBitField()&=address1.asBitField().MAX;
+			ppuState().address.update<PPUADDR::LOW_BYTE>(byte);
+			ppuState().address.update<PPUADDR::FIRST_WRITE_LO>(ppuState().scroll.select(PPUADDR::FIRST_WRITE_LO));
+			ppuState().address.update<PPUADDR::FIRST_WRITE_MID>(ppuState().control.select(PPUCTRL::CURRENT_NT));
+			ppuState().address.update<PPUADDR::FIRST_WRITE_HI>(ppuState().scroll.select(PPUADDR::FIRST_WRITE_HI));
+			ppuState().address.asBitField()&=ppuState().address.asBitField().MAX;
 			// check if correctly set
-			assert(valueOf(tmpAddress)==valueOf(address1));
+			assert(valueOf(ppuState().tmpAddress)==valueOf(ppuState().address));
 		}
-		firstWrite=!firstWrite;
+		ppuState().firstWrite=!ppuState().firstWrite;
 	}
 
 	static byte_t read()
 	{
-		const vaddr_t addr=mirror(address, true);
+		const vaddr_t addr=mirror(ppuState().address, true);
 		incAddress();
 		if (addr<0x3F00)
 		{
 			// return buffered data
-			const byte_t oldLatch=latch;
-			latch=vramData(addr);
+			const byte_t oldLatch=ppuState().latch;
+			ppuState().latch=(addr<0x2000)?ppuState().chrPages[addr>>10][addr&0x3FF]:vramData(addr);
 			return oldLatch;
 		}
 		// no buffering for palette memory access
@@ -285,7 +291,7 @@ namespace mem
 
 	static bool canWrite()
 	{
-		return !status[PPUSTATUS::WRITEIGNORED];
+		return !ppuState().status[PPUSTATUS::WRITEIGNORED];
 	}
 
 	static void write(const byte_t data)
@@ -293,82 +299,100 @@ namespace mem
 		// make sure it's safe to write
 		// assert(canWrite());
 
-		const vaddr_t addr=mirror(address, false);
+		const vaddr_t addr=mirror(ppuState().address, false);
 		{
 			// ?
 			// resetToggle();
 		}
-#ifdef WANT_MEM_PROTECTION
-		if (rom::count8KCHR()>0)
+		if (emu::active().cpu.checked && rom::count8KCHR()>0)
 		{
-			// don't allow writes to vrom if the rom file has any CHR-ROM data.
-			ERROR_IF(addr<0x2000, INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_WRITTEN, "vaddress", valueOf(address), "actual vaddress", valueOf(addr));
+			// with the cpu checks on, don't allow writes to vrom if the rom file has any CHR-ROM data.
+			ERROR_IF(addr<0x2000, INVALID_MEMORY_ACCESS, MEMORY_CANT_BE_WRITTEN, "vaddress", valueOf(ppuState().address), "actual vaddress", valueOf(addr));
+		}
+		// CHR-ROM pages are shared read-only, only CHR-RAM takes pattern writes
+		if (addr>=0x2000 || rom::count8KCHR()==0)
+		{
+			vramData(addr)=data;
+			if (addr<0x2000) renderState().tileCache[addr>>10].source=nullptr;
 		}
-#endif
-		vramData(addr)=data;
 		incAddress();
 	}
 }
 
 namespace render
 {
-	const int RENDER_WIDTH=256;
-	const int RENDER_HEIGHT=240;
-
 	static rgb32_t pal32[64];
-	static palindex_t vBuffer[RENDER_HEIGHT][RENDER_WIDTH];
-	static rgb32_t vBuffer32[SCREEN_HEIGHT*SCREEN_WIDTH];
-
-	static int8_t pendingSprites[64];
-	static int pendingSpritesCount;
-	static bool solidPixel[RENDER_WIDTH];
-	static bool spritePixel[RENDER_WIDTH];
 
 	static void setScroll(const byte_t byte)
 	{
 		if (mem::toggle())
 		{
 			// set horizontal scroll
-			xoffset=byte&7;
-			scroll.update<PPUADDR::XSCROLL>(byte>>3);
+			ppuState().xoffset=byte&7;
+			ppuState().scroll.update<PPUADDR::XSCROLL>(byte>>3);
 		}else
 		{
 			// set vertical scroll
-			scroll.update<PPUADDR::YOFFSET>(byte&7);
-			scroll.update<PPUADDR::YSCROLL>(byte>>3);
+			ppuState().scroll.update<PPUADDR::YOFFSET>(byte&7);
+			ppuState().scroll.update<PPUADDR::YSCROLL>(byte>>3);
 		}
 	}
 
 	static void getReload(int *FH, int *HT, int *VT, int *NT, int *FV)
 	{
-		if (FH) *FH=xoffset;
-		if (HT) *HT=scroll.select(PPUADDR::TILE_H);
-		if (VT) *VT=scroll.select(PPUADDR::TILE_V);
-		if (NT) *NT=control.select(PPUCTRL::CURRENT_NT);
-		if (FV) *FV=scroll.select(PPUADDR::YOFFSET);
+		if (FH) *FH=ppuState().xoffset;
+		if (HT) *HT=ppuState().scroll.select(PPUADDR::TILE_H);
+		if (VT) *VT=ppuState().scroll.select(PPUADDR::TILE_V);
+		if (NT) *NT=ppuState().control.select(PPUCTRL::CURRENT_NT);
+		if (FV) *FV=ppuState().scroll.select(PPUADDR::YOFFSET);
 	}
 
 	static void reloadVertical()
 	{
 		int VT, NT, FV;
 		getReload(0, 0, &VT, &NT, &FV);
-		address.update<PPUADDR::TILE_V>(VT);
-		address.update<PPUADDR::NT_V>(NT>>1);
-		address.update<PPUADDR::YOFFSET>(FV);
+		ppuState().address.update<PPUADDR::TILE_V>(VT);
+		ppuState().address.update<PPUADDR::NT_V>(NT>>1);
+		ppuState().address.update<PPUADDR::YOFFSET>(FV);
 	}
 
 	static void reloadHorizontal(int *FH=0)
 	{
 		int HT, NT;
 		getReload(FH, &HT, 0, &NT, 0);
-		address.update<PPUADDR::TILE_H>(HT);
-		address.update<PPUADDR::NT_H>(NT&1);
+		ppuState().address.update<PPUADDR::TILE_H>(HT);
+		ppuState().address.update<PPUADDR::NT_H>(NT&1);
 	}
 
 	static void clear()
 	{
 		// clear back buffer
-		memset(vBuffer, 0, sizeof(vBuffer));
+		memset(renderState().vBuffer, 0, sizeof(renderState().vBuffer));
+	}
+
+	static void copySprite(const int index)
+	{
+		renderState().spriteY[index]=oamSprite(index).yminus1;
+		renderState().spriteTile[index]=oamSprite(index).tile;
+		renderState().spriteAttr[index]=oamSprite(index).attrib;
+		renderState().spriteX[index]=oamSprite(index).x;
+	}
+
+	// to be called whenever OAM changes
+	static void invalidateSprites()
+	{
+		for (int i=0;i<64;i++)
+		{
+			copySprite(i);
+		}
+		renderState().spriteListHeight=0;
+	}
+
+	// to be called when a single OAM byte changes
+	static void updateSprite(const int index)
+	{
+		copySprite(index);
+		renderState().spriteListHeight=0;
 	}
 
 	static void reset()
@@ -376,15 +400,17 @@ namespace render
 		render::clear();
 
 		// also clear front buffer
-		memset(vBuffer32, 0, sizeof(vBuffer32));
+		memset(renderState().vBuffer32, 0, sizeof(renderState().vBuffer32));
 
-		pendingSpritesCount = 0;
-		memset(pendingSprites, -1, sizeof(pendingSprites));	
+		renderState().pendingSpritesCount = 0;
+		memset(renderState().pendingSprites, -1, sizeof(renderState().pendingSprites));	
+		renderState().skipCurrentFrame = false;
+		renderState().pendingScanline = -1;
 	}
 
 	bool enabled()
 	{
-		return mask[PPUMASK::BG_VISIBLE] || mask[PPUMASK::SPR_VISIBLE];
+		return ppuState().mask[PPUMASK::BG_VISIBLE] || ppuState().mask[PPUMASK::SPR_VISIBLE];
 	}
 
 	bool leftClipping()
@@ -392,12 +418,171 @@ namespace render
 #ifdef LEFT_CLIP
 		return true;
 #else
-		return mask[PPUMASK::BG_CLIP8] || mask[PPUMASK::SPR_CLIP8];
+		return ppuState().mask[PPUMASK::BG_CLIP8] || ppuState().mask[PPUMASK::SPR_CLIP8];
+#endif
+	}
+
+	void enablePresent(const bool enable)
+	{
+		renderState().presentFrames=enable;
+	}
+
+	// only every (frames+1)th frame is drawn and presented, 0 draws all of them
+	void setFrameSkip(const int frames)
+	{
+		assert(frames>=0);
+		renderState().frameSkip=frames;
+	}
+
+#ifdef WANT_SSSE3
+	static bool detectSSSE3()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2]&(1<<9))!=0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("ssse3")!=0;
 #endif
 	}
 
+	static const bool hasSSSE3=detectSSSE3();
+
+	// one byte plane of a 32 entry palette, each half of the plane is one shuffle table
+	struct PALPLANE
+	{
+		__m128i lower, upper;
+	};
+
+	static TARGET_SSSE3 void loadPlane(PALPLANE& plane, const uint8_t bytes[32])
+	{
+		plane.lower=_mm_loadu_si128((const __m128i*)&bytes[0]);
+		plane.upper=_mm_loadu_si128((const __m128i*)&bytes[16]);
+	}
+
+	// indexes with bit 7 set select zero, so each table only answers for its own half
+	static TARGET_SSSE3 FORCE_INLINE __m128i lookupPlane(const PALPLANE& plane, const __m128i lowerIdx, const __m128i upperIdx)
+	{
+		return _mm_or_si128(_mm_shuffle_epi8(plane.lower, lowerIdx), _mm_shuffle_epi8(plane.upper, upperIdx));
+	}
+
+	// toRgb32() 16 pixels at a time, returns the pixels converted
+	static TARGET_SSSE3 int toRgb32SSSE3(const palindex_t* vBufIdx, rgb32_t* vBuf32, const int count, const rgb32_t p32[32])
+	{
+		int j=0;
+		uint8_t bytes[4][32];
+		for (int i=0;i<32;i++)
+		{
+			for (int k=0;k<4;k++) bytes[k][i]=(uint8_t)(p32[i]>>(k<<3));
+		}
+		PALPLANE planes[4];
+		for (int k=0;k<4;k++) loadPlane(planes[k], bytes[k]);
+		const __m128i toLower=_mm_set1_epi8(0x70);
+		const __m128i toUpper=_mm_set1_epi8(-16);
+		for (;j+16<=count;j+=16)
+		{
+			const __m128i idx=_mm_loadu_si128((const __m128i*)(vBufIdx+j));
+			const __m128i lowerIdx=_mm_add_epi8(idx, toLower);
+			const __m128i upperIdx=_mm_add_epi8(idx, toUpper);
+			__m128i pixels[4];
+			for (int k=0;k<4;k++) pixels[k]=lookupPlane(planes[k], lowerIdx, upperIdx);
+			// interleave the planes back into pixels
+			const __m128i lo01=_mm_unpacklo_epi8(pixels[0], pixels[1]);
+			const __m128i hi01=_mm_unpackhi_epi8(pixels[0], pixels[1]);
+			const __m128i lo23=_mm_unpacklo_epi8(pixels[2], pixels[3]);
+			const __m128i hi23=_mm_unpackhi_epi8(pixels[2], pixels[3]);
+			_mm_storeu_si128((__m128i*)(vBuf32+j), _mm_unpacklo_epi16(lo01, lo23));
+			_mm_storeu_si128((__m128i*)(vBuf32+j+4), _mm_unpackhi_epi16(lo01, lo23));
+			_mm_storeu_si128((__m128i*)(vBuf32+j+8), _mm_unpacklo_epi16(hi01, hi23));
+			_mm_storeu_si128((__m128i*)(vBuf32+j+12), _mm_unpackhi_epi16(hi01, hi23));
+		}
+		return j;
+	}
+
+	// toRgb16() 16 pixels at a time, returns the pixels converted
+	static TARGET_SSSE3 int toRgb16SSSE3(const palindex_t* vBufIdx, rgb16_t* vBuf16, const int count, const rgb16_t p16[32])
+	{
+		int j=0;
+		uint8_t bytes[2][32];
+		for (int i=0;i<32;i++)
+		{
+			bytes[0][i]=(uint8_t)p16[i];
+			bytes[1][i]=(uint8_t)(p16[i]>>8);
+		}
+		PALPLANE planes[2];
+		for (int k=0;k<2;k++) loadPlane(planes[k], bytes[k]);
+		const __m128i toLower=_mm_set1_epi8(0x70);
+		const __m128i toUpper=_mm_set1_epi8(-16);
+		for (;j+16<=count;j+=16)
+		{
+			const __m128i idx=_mm_loadu_si128((const __m128i*)(vBufIdx+j));
+			const __m128i lowerIdx=_mm_add_epi8(idx, toLower);
+			const __m128i upperIdx=_mm_add_epi8(idx, toUpper);
+			const __m128i lo=lookupPlane(planes[0], lowerIdx, upperIdx);
+			const __m128i hi=lookupPlane(planes[1], lowerIdx, upperIdx);
+			_mm_storeu_si128((__m128i*)(vBuf16+j), _mm_unpacklo_epi8(lo, hi));
+			_mm_storeu_si128((__m128i*)(vBuf16+j+8), _mm_unpackhi_epi8(lo, hi));
+		}
+		return j;
+	}
+
+	// toIndexed8() 16 pixels at a time, returns the pixels converted
+	static TARGET_SSSE3 int toIndexed8SSSE3(const palindex_t* vBufIdx, uint8_t* vBuf8, const int count, const uint8_t p8[32])
+	{
+		int j=0;
+		PALPLANE plane;
+		loadPlane(plane, p8);
+		const __m128i toLower=_mm_set1_epi8(0x70);
+		const __m128i toUpper=_mm_set1_epi8(-16);
+		for (;j+16<=count;j+=16)
+		{
+			const __m128i idx=_mm_loadu_si128((const __m128i*)(vBufIdx+j));
+			const __m128i lowerIdx=_mm_add_epi8(idx, toLower);
+			const __m128i upperIdx=_mm_add_epi8(idx, toUpper);
+			_mm_storeu_si128((__m128i*)(vBuf8+j), lookupPlane(plane, lowerIdx, upperIdx));
+		}
+		return j;
+	}
+#endif
+
+	// converts palette indexes to colors with the 32 entries of p32
+	static void toRgb32(const palindex_t* vBufIdx, rgb32_t* vBuf32, const int count, const rgb32_t p32[32])
+	{
+		int j=0;
+#ifdef WANT_SSSE3
+		if (hasSSSE3) j=toRgb32SSSE3(vBufIdx, vBuf32, count, p32);
+#endif
+		for (;j<count;j++)
+			vBuf32[j]=p32[valueOf(vBufIdx[j])];
+	}
+
+	// same for RGB565 colors, the ui only blits RGB32 so present() does not use it yet
+	static void toRgb16(const palindex_t* vBufIdx, rgb16_t* vBuf16, const int count, const rgb16_t p16[32])
+	{
+		int j=0;
+#ifdef WANT_SSSE3
+		if (hasSSSE3) j=toRgb16SSSE3(vBufIdx, vBuf16, count, p16);
+#endif
+		for (;j<count;j++)
+			vBuf16[j]=p16[valueOf(vBufIdx[j])];
+	}
+
+	// same for 8-bit indexed output, p8 normally holds the NES color index of each entry
+	static void toIndexed8(const palindex_t* vBufIdx, uint8_t* vBuf8, const int count, const uint8_t p8[32])
+	{
+		int j=0;
+#ifdef WANT_SSSE3
+		if (hasSSSE3) j=toIndexed8SSSE3(vBufIdx, vBuf8, count, p8);
+#endif
+		for (;j<count;j++)
+			vBuf8[j]=p8[valueOf(vBufIdx[j])];
+	}
+
 	static void present()
 	{
+		if (!renderState().presentFrames || renderState().skipCurrentFrame) return;
+
 		if (enabled())
 		{
 			// cache palette colors
@@ -405,18 +590,14 @@ namespace render
 			for (int i=0;i<32;i++) p32[i]=pal32[colorIdx(i)];
 
 			// look up each pixel
-			rgb32_t* vBuf32=vBuffer32;
-			const palindex_t* vBufIdx=&vBuffer[SCREEN_YOFFSET][0];
 			for (int i=0;i<SCREEN_HEIGHT;i++)
 			{
-				vBufIdx+=SCREEN_XOFFSET;
-				for (int j=0;j<SCREEN_WIDTH;j++)
-					*vBuf32++=p32[valueOf(*vBufIdx++)];
+				toRgb32(&renderState().vBuffer[SCREEN_YOFFSET+i][SCREEN_XOFFSET], renderState().vBuffer32+i*SCREEN_WIDTH, SCREEN_WIDTH, p32);
 			}
 		}
 		
 		// display
-		emu::present(vBuffer32, SCREEN_WIDTH, SCREEN_HEIGHT);
+		emu::present(renderState().vBuffer32, SCREEN_WIDTH, SCREEN_HEIGHT);
 	}
 
 	static void startVBlank()
@@ -424,11 +605,11 @@ namespace render
 		// present frame onto screen
 		present();
 		// set VBlank flag
-		status|=PPUSTATUS::VBLANK;
+		ppuState().status|=PPUSTATUS::VBLANK;
 		// allow writes
-		status-=PPUSTATUS::WRITEIGNORED;
+		ppuState().status-=PPUSTATUS::WRITEIGNORED;
 		// do NMI
-		if (control[PPUCTRL::NMI_ENABLED])
+		if (ppuState().control[PPUCTRL::NMI_ENABLED])
 		{
 			cpu::irq(IRQTYPE::NMI);
 		}
@@ -445,9 +626,9 @@ namespace render
 	static void endVBlank()
 	{
 		// clear VBlank flag
-		status-=PPUSTATUS::VBLANK;
+		ppuState().status-=PPUSTATUS::VBLANK;
 		// clear HIT flag
-		status-=PPUSTATUS::HIT;
+		ppuState().status-=PPUSTATUS::HIT;
 	}
 
 	static void preRender()
@@ -455,7 +636,7 @@ namespace render
 		if (enabled())
 		{
 			reloadVertical();
-			status|=PPUSTATUS::WRITEIGNORED;
+			ppuState().status|=PPUSTATUS::WRITEIGNORED;
 		}
 	}
 
@@ -465,74 +646,117 @@ namespace render
 
 	static void beginFrame()
 	{
-		emu::onFrameBegin();
+		renderState().skipCurrentFrame=(renderState().frameSkip>0 && ppuState().frameNum%(renderState().frameSkip+1)!=0);
+		if (renderState().presentFrames) emu::onFrameBegin();
 	}
 
 	static void endFrame()
 	{
-		++frameNum;
+		++ppuState().frameNum;
+
+		if (renderState().presentFrames) emu::onFrameEnd();
+	}
+
+	// set address to next scanline
+	static void nextScanlineAddress()
+	{
+		if (ppuState().address.inc(PPUADDR::YOFFSET)==0)
+		{
+			if (ppuState().address.inc(PPUADDR::YSCROLL)==30)
+			{
+				ppuState().address.update<PPUADDR::YSCROLL>(0);
+				ppuState().address.flip(PPUADDR::NT_V);
+				// no need to update scroll reload
+			}
+		}
+	}
+
+	// expands decoded pattern rows to palette indexes, and marks the opaque pixels.
+	// 8 pixels are written per row.
+	static void expandTilesScalar(const uint16_t colorD0D1s[], const uint8_t colorD2D3[], const int count, uint8_t pixels[], uint8_t opaque[])
+	{
+		for (int i=0;i<count;i++)
+		{
+			for (int x=0;x<8;x++)
+			{
+				const uint8_t colorD0D1=(colorD0D1s[i]>>(x<<1))&3;
+				pixels[(i<<3)+x]=colorD0D1|colorD2D3[i];
+				opaque[(i<<3)+x]=(colorD0D1!=0);
+			}
+		}
+	}
 
-		emu::onFrameEnd();
+	// same as expandTilesScalar(), count must be even.
+	// the attribute bits come in per tile: they are looked up while gathering the tiles.
+	static void expandTiles(const uint16_t colorD0D1s[], const uint8_t colorD2D3[], const int count, uint8_t pixels[], uint8_t opaque[])
+	{
+		assert((count&1)==0);
+#ifdef WANT_SSE2
+		// multiplying moves the 2 bits of each pixel to the top of its own 16-bit lane
+		const __m128i toTop=_mm_setr_epi16(1<<14, 1<<12, 1<<10, 1<<8, 1<<6, 1<<4, 1<<2, 1);
+		const __m128i one=_mm_set1_epi8(1);
+		for (int i=0;i<count;i+=2)
+		{
+			const __m128i left=_mm_srli_epi16(_mm_mullo_epi16(_mm_set1_epi16((short)colorD0D1s[i]), toTop), 14);
+			const __m128i right=_mm_srli_epi16(_mm_mullo_epi16(_mm_set1_epi16((short)colorD0D1s[i+1]), toTop), 14);
+			const __m128i colorD0D1=_mm_packus_epi16(left, right);
+			const __m128i colorHi=_mm_unpacklo_epi64(_mm_set1_epi8((char)colorD2D3[i]), _mm_set1_epi8((char)colorD2D3[i+1]));
+			_mm_storeu_si128((__m128i*)(pixels+(i<<3)), _mm_or_si128(colorD0D1, colorHi));
+			_mm_storeu_si128((__m128i*)(opaque+(i<<3)), _mm_and_si128(_mm_cmpgt_epi8(colorD0D1, _mm_setzero_si128()), one));
+		}
+#else
+		expandTilesScalar(colorD0D1s, colorD2D3, count, pixels, opaque);
+#endif
 	}
 
 	static void drawBackground()
 	{
-		if (mask[PPUMASK::BG_VISIBLE])
+		if (ppuState().mask[PPUMASK::BG_VISIBLE])
 		{
 			// determine origin
-			int xoffset;
-			reloadHorizontal(&xoffset);
-			int startX=(address(PPUADDR::XSCROLL)<<3)+xoffset;
-			const int startY=(address(PPUADDR::YSCROLL)<<3)+address(PPUADDR::YOFFSET);
+			int fineX;
+			reloadHorizontal(&fineX);
+			int startX=(ppuState().address(PPUADDR::XSCROLL)<<3)+fineX;
+			const int startY=(ppuState().address(PPUADDR::YSCROLL)<<3)+ppuState().address(PPUADDR::YOFFSET);
 
 			assert(startX>=0 && startX<256);
 			assert(startY>=0 && startY<256);
 
 			// determine what tables to use for the first part
-			vaddr_flag_t mirrored(mem::ntMirror(address));
+			vaddr_flag_t mirrored(mem::ntMirror(ppuState().address));
 			const NESVRAM::NAMEATTRIB_TABLE::NAME_TABLE *nt;
 			const NESVRAM::NAMEATTRIB_TABLE::ATTRIBUTE_TABLE *attr;
-			const NESVRAM::VROM::PATTERN_TABLE *pt;
+			const int pt=ppuState().control[PPUCTRL::BG_PATTERN]?1:0;
 			nt=&vramNt(mirrored(PPUADDR::NT));
 			attr=&vramAt(mirrored(PPUADDR::NT));
-			pt=&vramPt(control[PPUCTRL::BG_PATTERN]?1:0);
 
 			// determine tile position in current name table
 			const int tileRow=(startY>>3)%30;
 			const int tileYOffset=startY&7;
 
+			// gather the 32 or 33 tiles the scanline crosses, the first visible pixel is at (startX&7)
+			uint16_t colorD0D1s[34];
+			uint8_t colorD2D3[34];
+			int count=0;
 			for (int tileCounter=(startX>>3);tileCounter<=31;tileCounter++)
 			{
 				const tileid_t tileIndex(nt->tiles[tileRow][tileCounter]);
-				const int X = (tileCounter<<3)+7-startX;
-
-				// look up the tile in attribute table to find its color (D2 and D3)
-				const byte_t colorD2D3 = attr->lookup(tileRow, tileCounter);
 
 				// look up the tile in pattern table to find its color (D0 and D1)
-				const byte_t colorD0 = pt->tiles[tileIndex].colorD0[tileYOffset];
-				const byte_t colorD1 = pt->tiles[tileIndex].colorD1[tileYOffset];
-
-				for (int pixel=min(X,7);pixel>=0;pixel--)
-				{
-					// Note: B0 indicates the color at the 7th pixel of the tile
-					const byte_t colorD0D1 = ((colorD0>>pixel)&1)|(((colorD1>>pixel)<<1)&2);
-					const byte_t color = colorD0D1|colorD2D3;
-					// write to frame buffer
-					vassert(X-pixel>=0 && X-pixel<RENDER_WIDTH);
-					vBuffer[scanline][X-pixel]=color;
-				}
+				colorD0D1s[count]=mem::decodedTile(pt, tileIndex)[tileYOffset];
+				// look up the tile in attribute table to find its color (D2 and D3)
+				colorD2D3[count++]=attr->lookup(tileRow, tileCounter);
 			}
 
 			if (startX>=0)
 			{
-				// now render for the second part
+				// now gather for the second part
 				// switch across to the next tables
 				{
 					// ?
-					address.flip(PPUADDR::NT_H);
+					ppuState().address.flip(PPUADDR::NT_H);
 				}
-				mirrored=mem::ntMirror(address);
+				mirrored=mem::ntMirror(ppuState().address);
 				nt=&vramNt(mirrored(PPUADDR::NT));
 				attr=&vramAt(mirrored(PPUADDR::NT));
 
@@ -540,36 +764,32 @@ namespace render
 				for (int tileCounter=0;tileCounter<endTile;tileCounter++)
 				{
 					const tileid_t tileIndex(nt->tiles[tileRow][tileCounter]);
-					const int X = (tileCounter<<3)+7+(256-startX);
+					colorD0D1s[count]=mem::decodedTile(pt, tileIndex)[tileYOffset];
+					colorD2D3[count++]=attr->lookup(tileRow, tileCounter);
+				}
+			}
+			vassert((count<<3)>=RENDER_WIDTH+(startX&7));
 
-					// look up the tile in attribute table to find its color (D2 and D3)
-					const byte_t colorD2D3 = attr->lookup(tileRow, tileCounter);
+			// pad to an even count for the kernel
+			colorD0D1s[count]=0;
+			colorD2D3[count]=0;
 
-					// look up the tile in pattern table to find its color (D0 and D1)
-					const byte_t colorD0 = pt->tiles[tileIndex].colorD0[tileYOffset];
-					const byte_t colorD1 = pt->tiles[tileIndex].colorD1[tileYOffset];
+			uint8_t pixels[34*8];
+			uint8_t opaque[34*8];
+			expandTiles(colorD0D1s, colorD2D3, (count+1)&~1, pixels, opaque);
 
-					for (int pixel=max(X-255,0);pixel<=7;pixel++)
-					{
-						// Note: B0 indicates the color at the 7th pixel of the tile
-						const byte_t colorD0D1 = ((colorD0>>pixel)&1)|(((colorD1>>pixel)<<1)&2);
-						const byte_t color = colorD0D1|colorD2D3;
-						// write to frame buffer
-						vassert(X-pixel>=0 && X-pixel<RENDER_WIDTH);
-						vBuffer[scanline][X-pixel]=color;
-					}
-				}
-			}
+			// write to frame buffer
+			STATIC_ASSERT(sizeof(palindex_t)==1 && sizeof(bool)==1);
+			memcpy((void*)&renderState().vBuffer[ppuState().scanline][0], pixels+(startX&7), RENDER_WIDTH);
+			memcpy(renderState().solidPixel, opaque+(startX&7), RENDER_WIDTH);
 
-			// set address to next scanline
-			if (address.inc(PPUADDR::YOFFSET)==0)
+			nextScanlineAddress();
+		}else
+		{
+			// the scanline keeps what the previous frame left there
+			for (int i=0;i<RENDER_WIDTH;i++)
 			{
-				if (address.inc(PPUADDR::YSCROLL)==30)
-				{
-					address.update<PPUADDR::YSCROLL>(0);
-					address.flip(PPUADDR::NT_V);
-					// no need to update scroll reload
-				}
+				renderState().solidPixel[i]=((renderState().vBuffer[ppuState().scanline][i]&3)!=0); // indicate whether a background pixel is opaque
 			}
 		}
 	}
@@ -579,34 +799,72 @@ namespace render
 	static int visibleBackSpriteCount;
 #endif
 
+	// bit i is set when sprite i starts on a visible scanline
+	static uint64_t visibleSprites()
+	{
+		uint64_t bits=0;
+#ifdef WANT_SSE2
+		const __m128i lastY=_mm_set1_epi8((char)(RENDER_HEIGHT-2));
+		for (int i=0;i<64;i+=16)
+		{
+			const __m128i y=_mm_loadu_si128((const __m128i*)&renderState().spriteY[i]);
+			// unsigned y<=lastY
+			const __m128i visible=_mm_cmpeq_epi8(_mm_min_epu8(y, lastY), y);
+			bits|=(uint64_t)(unsigned)_mm_movemask_epi8(visible)<<i;
+		}
+#else
+		for (int i=0;i<64;i++)
+		{
+			if (renderState().spriteY[i]<=RENDER_HEIGHT-2) bits|=(uint64_t)1<<i;
+		}
+#endif
+		return bits;
+	}
+
+	static void buildSpriteLists(const int sprHeight)
+	{
+		memset(renderState().scanlineSpriteCount, 0, sizeof(renderState().scanlineSpriteCount));
+		uint64_t bits=visibleSprites();
+		for (int i=0;bits!=0;i++, bits>>=1)
+		{
+			if ((bits&1)==0) continue;
+
+			// the sprite covers scanlines (yminus1, yminus1+sprHeight]
+			const int top=renderState().spriteY[i]+1;
+			for (int line=top;line<top+sprHeight && line<RENDER_HEIGHT;line++)
+			{
+				renderState().scanlineSprites[line][renderState().scanlineSpriteCount[line]++]=i;
+			}
+		}
+		renderState().spriteListHeight=sprHeight;
+	}
+
 	static void evaluateSprites()
 	{
-		pendingSpritesCount=0;
+		renderState().pendingSpritesCount=0;
 
-		if (mask[PPUMASK::SPR_VISIBLE])
+		if (ppuState().mask[PPUMASK::SPR_VISIBLE])
 		{
-			status-=PPUSTATUS::COUNTGT8;
+			ppuState().status-=PPUSTATUS::COUNTGT8;
 
 			// find sprites that are within y range for the scanline
-			const int sprHeight=control[PPUCTRL::LARGE_SPRITE]?16:8;
-
-			for (int i=0;i<64;i++)
+			const int sprHeight=ppuState().control[PPUCTRL::LARGE_SPRITE]?16:8;
+			if (renderState().spriteListHeight!=sprHeight)
 			{
-				if (oamSprite(i).yminus1<scanline && oamSprite(i).yminus1+sprHeight>=scanline)
-				{
+				buildSpriteLists(sprHeight);
+			}
+
+			int count=renderState().scanlineSpriteCount[ppuState().scanline];
 #ifdef SPRITE_LIMIT
-					if (pendingSpritesCount>=8)
-					{
-						// more than 8 sprites appear in this scanline
-						status|=PPUSTATUS::COUNTGT8;
-						break;
-					}else
-#endif
-					{
-						pendingSprites[pendingSpritesCount++]=i;
-					}
-				}
+			if (count>8)
+			{
+				// more than 8 sprites appear in this scanline
+				ppuState().status|=PPUSTATUS::COUNTGT8;
+				count=8;
 			}
+#endif
+			memcpy(renderState().pendingSprites, renderState().scanlineSprites[ppuState().scanline], count);
+			renderState().pendingSpritesCount=count;
 
 #ifdef MONITOR_RENDERING
 			// count visible sprites
@@ -623,75 +881,82 @@ namespace render
 				}
 			}
 #endif
-			for (int i=0;i<RENDER_WIDTH;i++)
-			{
-				solidPixel[i]=((vBuffer[scanline][i]&3)!=0); // indicate whether a background pixel is opaque
-				spritePixel[i]=false;
-			}
+			memset(renderState().spritePixel, 0, sizeof(renderState().spritePixel));
 		}
 	}
 
+	// decoded row of a sprite on the current scanline, pixels in screen order
+	static uint16_t spriteRow(const int sprId)
+	{
+		const int sprHeight=ppuState().control[PPUCTRL::LARGE_SPRITE]?16:8;
+		const int tile=renderState().spriteTile[sprId];
+		const auto attrib=renderState().spriteAttr[sprId];
+
+		int sprYOffset = ppuState().scanline-(renderState().spriteY[sprId]+1);
+		vassert(sprYOffset>=0 && sprYOffset<sprHeight);
+		if (attrib[SPRATTR::FLIP_V])
+		{
+			sprYOffset=sprHeight-1-sprYOffset;
+		}
+
+		// look up the tile in pattern table to find its color (D0 and D1)
+		const int tileYOffset=sprYOffset&7;
+		int pt;
+		tileid_t tileIndex;
+		if (ppuState().control[PPUCTRL::LARGE_SPRITE])
+		{
+			tileIndex=(tile&~1)|(sprYOffset>>3);
+			pt=tile&1;
+		}else
+		{
+			tileIndex=tile;
+			pt=ppuState().control[PPUCTRL::SPR_PATTERN]?1:0;
+		}
+		// the flipped rows already have the pixels in screen order
+		return mem::decodedTile(pt, tileIndex, attrib[SPRATTR::FLIP_H])[tileYOffset];
+	}
+
+	// whether an opaque pixel of sprite 0 at X sets the hit flag
+	static bool hitsSprite0(const int X)
+	{
+		// background is non-transparent here
+		return renderState().solidPixel[X] && ppuState().mask[PPUMASK::BG_VISIBLE] && !(leftClipping() && X<8) && X!=255;
+	}
+
 	static void drawSprites()
 	{
-		if (pendingSpritesCount>0)
+		if (renderState().pendingSpritesCount>0)
 		{
 			const int sprWidth=8;
-			const int sprHeight=control[PPUCTRL::LARGE_SPRITE]?16:8;
 
-			for (int i=0;i<pendingSpritesCount;i++)
+			for (int i=0;i<renderState().pendingSpritesCount;i++)
 			{
-				const int sprId = pendingSprites[i];
-				const auto spr = oamSprite(sprId);
-				const bool behindBG = spr.attrib[SPRATTR::BEHIND_BG];
-
-				// get the sprite info
-				int sprYOffset = scanline-(spr.yminus1+1);
-				vassert(sprYOffset>=0 && sprYOffset<sprHeight);
-				if (spr.attrib[SPRATTR::FLIP_V])
-				{
-					sprYOffset=sprHeight-1-sprYOffset;
-				}
-				const byte_t colorD2D3 = spr.attrib.select(SPRATTR::COLOR_HI)<<2;
+				const int sprId = renderState().pendingSprites[i];
+				const auto attrib = renderState().spriteAttr[sprId];
+				const bool behindBG = attrib[SPRATTR::BEHIND_BG];
+				const byte_t colorD2D3 = attrib.select(SPRATTR::COLOR_HI)<<2;
+				const uint16_t colorD0D1s = spriteRow(sprId);
 
 				for (int pixel=0;pixel<sprWidth;pixel++)
 				{
-					const int X=spr.x+pixel;
+					const int X=renderState().spriteX[sprId]+pixel;
 					if (X>255) break;
 
-					const NESVRAM::VROM::PATTERN_TABLE *pt;
-					const int tileXOffset=spr.attrib[SPRATTR::FLIP_H]?(sprWidth-1-pixel):pixel;
-					const int tileYOffset=sprYOffset&7;
-					tileid_t tileIndex;
-					if (control[PPUCTRL::LARGE_SPRITE])
-					{
-						tileIndex=(spr.tile&~1)|(sprYOffset>>3);
-						pt=&vramPt(spr.tile&1);
-					}else
-					{
-						tileIndex=spr.tile;
-						pt=&vramPt(control[PPUCTRL::SPR_PATTERN]?1:0);
-					}
-
-					// look up the tile in pattern table to find its color (D0 and D1)
-					const byte_t colorD0 = pt->tiles[tileIndex].colorD0[tileYOffset];
-					const byte_t colorD1 = pt->tiles[tileIndex].colorD1[tileYOffset];
-
-					const byte_t colorD0D1 = ((colorD0>>(7-tileXOffset))&1)|(((colorD1>>(7-tileXOffset))<<1)&2);
+					const byte_t colorD0D1 = (colorD0D1s>>(pixel<<1))&3;
 					const byte_t color = colorD0D1|colorD2D3|0x10;
 
 					if (colorD0D1) // opaque sprite pixel
 					{
 						// sprite 0 hit detection (regardless priority)
-						if (sprId==0 && !status[PPUSTATUS::HIT] && solidPixel[X] && mask[PPUMASK::BG_VISIBLE] && !(leftClipping() && X<8) && X!=255)
+						if (sprId==0 && !ppuState().status[PPUSTATUS::HIT] && hitsSprite0(X))
 						{
-							// background is non-transparent here
-							status|=PPUSTATUS::HIT;
+							ppuState().status|=PPUSTATUS::HIT;
 						}
 						// write to frame buffer
-						if (!spritePixel[X])
+						if (!renderState().spritePixel[X])
 						{
-							if (!behindBG || !solidPixel[X]) vBuffer[scanline][X]=color;
-							spritePixel[X]=true;
+							if (!behindBG || !renderState().solidPixel[X]) renderState().vBuffer[ppuState().scanline][X]=color;
+							renderState().spritePixel[X]=true;
 						}
 					}
 
@@ -702,24 +967,84 @@ namespace render
 		}
 	}
 
+	// a scanline of a skipped frame: no pixels, but the same scrolling, sprite overflow and sprite 0 hit
+	static void skipScanline()
+	{
+		evaluateSprites();
+		const bool testHit=(renderState().pendingSpritesCount>0 && renderState().pendingSprites[0]==0 && !ppuState().status[PPUSTATUS::HIT]);
+
+		if (ppuState().mask[PPUMASK::BG_VISIBLE])
+		{
+			// determine origin
+			int fineX;
+			reloadHorizontal(&fineX);
+			const int startX=(ppuState().address(PPUADDR::XSCROLL)<<3)+fineX;
+			const int startY=(ppuState().address(PPUADDR::YSCROLL)<<3)+ppuState().address(PPUADDR::YOFFSET);
+
+			const vaddr_flag_t left(mem::ntMirror(ppuState().address));
+			ppuState().address.flip(PPUADDR::NT_H);
+			const vaddr_flag_t right(mem::ntMirror(ppuState().address));
+
+			if (testHit)
+			{
+				// only the background under sprite 0 is needed
+				const int pt=ppuState().control[PPUCTRL::BG_PATTERN]?1:0;
+				const int tileRow=(startY>>3)%30;
+				const int tileYOffset=startY&7;
+				const int sprX=renderState().spriteX[0];
+				for (int X=sprX;X<sprX+8 && X<RENDER_WIDTH;X++)
+				{
+					const int x=startX+X;
+					const NESVRAM::NAMEATTRIB_TABLE::NAME_TABLE *nt=&vramNt((x<256?left:right)(PPUADDR::NT));
+					const tileid_t tileIndex(nt->tiles[tileRow][(x&255)>>3]);
+					const uint16_t colorD0D1s=mem::decodedTile(pt, tileIndex)[tileYOffset];
+					renderState().solidPixel[X]=((colorD0D1s>>((x&7)<<1))&3)!=0;
+				}
+			}
+
+			nextScanlineAddress();
+		}
+
+		if (testHit)
+		{
+			const uint16_t colorD0D1s=spriteRow(0);
+			for (int pixel=0;pixel<8;pixel++)
+			{
+				const int X=renderState().spriteX[0]+pixel;
+				if (X>255) break;
+				if (((colorD0D1s>>(pixel<<1))&3) && hitsSprite0(X))
+				{
+					ppuState().status|=PPUSTATUS::HIT;
+					break;
+				}
+			}
+		}
+	}
+
 	static void renderScanline()
 	{
 		if (enabled())
 		{
-			if (scanline>=0 && scanline<=239)
+			if (ppuState().scanline>=0 && ppuState().scanline<=239)
 			{
 			#ifdef MONITOR_RENDERING
-				printf("[P] --- Scanline %03d --- Sprite 0: (%d, %d) %c%c%c Scroll=[%3d,%3d] %d+%d visible\n", scanline, oamSprite(0).x, oamSprite(0).yminus1+1, 
+				printf("[P] --- Scanline %03d --- Sprite 0: (%d, %d) %c%c%c Scroll=[%3d,%3d] %d+%d visible\n", ppuState().scanline, oamSprite(0).x, oamSprite(0).yminus1+1, 
 					(rom::mirrorMode()==MIRRORING::HORIZONTAL)?'H':'V',
-					mask[PPUMASK::SPR_VISIBLE]?'S':'-',
-					mask[PPUMASK::BG_VISIBLE]?'B':'-',
-					scroll(PPUADDR::XSCROLL)*8+xoffset,
-					scroll(PPUADDR::YSCROLL)*8+scroll(PPUADDR::YOFFSET),
+					ppuState().mask[PPUMASK::SPR_VISIBLE]?'S':'-',
+					ppuState().mask[PPUMASK::BG_VISIBLE]?'B':'-',
+					ppuState().scroll(PPUADDR::XSCROLL)*8+ppuState().xoffset,
+					ppuState().scroll(PPUADDR::YSCROLL)*8+ppuState().scroll(PPUADDR::YOFFSET),
 					visibleFrontSpriteCount, visibleBackSpriteCount);
 			#endif
-				drawBackground();
-				evaluateSprites();
-				drawSprites();
+				if (renderState().skipCurrentFrame)
+				{
+					skipScanline();
+				}else
+				{
+					drawBackground();
+					evaluateSprites();
+					drawSprites();
+				}
 			}else
 			{
 				// dummy scanline
@@ -727,36 +1052,86 @@ namespace render
 		}
 	}
 
+	// first scanline from the current one on that has to go through HBlank(),
+	// either for the ppu itself or for the mapper. the lines before it are only counted.
+	// sprite 0 hit is no event: a $2002 read catches up to the line the cpu is on first,
+	// so the flag shows up on the same line as if every line had been drawn at its hblank.
+	static int nextEventLine()
+	{
+		int line;
+		if (ppuState().scanline<0) line=-1; // pre-render
+		else if (ppuState().scanline<=240) line=240; // vblank start
+		else if (ppuState().scanline<=260) line=260; // vblank end
+		else line=261; // end of frame
+		return min(line, mapper::nextEventLine(ppuState().scanline));
+	}
+
+	// lets count scanlines pass with nothing to do for them but to be drawn later
+	static void skipScanlines(const int count)
+	{
+		if (count<=0) return;
+		assert(ppuState().scanline+count<=nextEventLine());
+
+		if (ppuState().scanline>=0 && ppuState().scanline<=239 && renderState().pendingScanline<0) renderState().pendingScanline=ppuState().scanline;
+		mapper::skipScanlines(ppuState().scanline, count);
+		ppuState().scanline+=count;
+		ppuState().lineStart+=(long long)count*SCANLINE_CYCLES;
+	}
+
+	// brings the scanline counter up to the line the cpu is running
+	static void sync()
+	{
+		const long long elapsed=cpu::cycleCount()-ppuState().lineStart;
+		if (elapsed<SCANLINE_CYCLES) return;
+		skipScanlines((int)min(elapsed/SCANLINE_CYCLES, (long long)(nextEventLine()-ppuState().scanline)));
+	}
+
+	// draws the visible scanlines the cpu has already run past.
+	// to be called before anything that reads or changes the state they are drawn from.
+	static void catchUp()
+	{
+		sync();
+		if (renderState().pendingScanline<0) return;
+
+		const int current=ppuState().scanline;
+		for (ppuState().scanline=renderState().pendingScanline;ppuState().scanline<current;ppuState().scanline++)
+		{
+			renderScanline();
+		}
+		renderState().pendingScanline=-1;
+	}
+
 	static bool HBlank()
 	{
-		if (scanline==-1)
+		if (ppuState().scanline==-1)
 		{
 			beginFrame();
 			preRender();
-		}else if (scanline>=0 && scanline<=239)
+		}else if (ppuState().scanline>=0 && ppuState().scanline<=239)
 		{
-			// visible scanlines
-			renderScanline();
-		}else if (scanline==240)
+			// visible scanlines are drawn later in one batch, see catchUp()
+			if (renderState().pendingScanline<0) renderState().pendingScanline=ppuState().scanline;
+		}else if (ppuState().scanline==240)
 		{
+			catchUp();
 			// dummy scanline
 			renderScanline();
 			postRender();
 			// enter vblank
 			startVBlank();
-		}else if (scanline>=241 && scanline<=259)
+		}else if (ppuState().scanline>=241 && ppuState().scanline<=259)
 		{
 			duringVBlank();
-		}else if (scanline==260)
+		}else if (ppuState().scanline==260)
 		{
 			endVBlank();
-		}else if (scanline==261)
+		}else if (ppuState().scanline==261)
 		{
 			endFrame();
-			scanline=-1;
+			ppuState().scanline=-1;
 			return false;
 		}
-		scanline++;
+		ppuState().scanline++;
 		return true;
 	}
 
@@ -834,57 +1209,75 @@ namespace ppu
 	void reset()
 	{
 		// reset all registers
-		control1.clearAll();
-		control2.clearAll();
-		status.clearAll();
+		ppuState().control.clearAll();
+		ppuState().mask.clearAll();
+		ppuState().status.clearAll();
 
-		address1.clearAll();
-		address2.clearAll();
-		tmpAddress.clearAll();
+		ppuState().address.clearAll();
+		ppuState().scroll.clearAll();
+		ppuState().tmpAddress.clearAll();
 
 		// reset counters
-		scanline = -1;
-		frameNum = 0;
+		ppuState().scanline = -1;
+		ppuState().frameNum = 0;
+		ppuState().lineStart = cpu::cycleBudget();
 
 		// reset renderer
 		render::reset();
 
 		// reset memory
 		mem::reset();
+		render::invalidateSprites();
 	}
 
-	void save(FILE *fp)
+	void save(SNAPSHOT& s)
 	{
-		// registers
-		fwrite(&control, sizeof(control), 1, fp);
-		fwrite(&mask, sizeof(mask), 1, fp);
-		fwrite(&status, sizeof(status), 1, fp);
-
-		fwrite(&scroll, sizeof(scroll), 1, fp);
-		fwrite(&xoffset, sizeof(xoffset), 1, fp);
-		fwrite(&address, sizeof(address), 1, fp);
-
-		fwrite(&oamAddr, sizeof(oamAddr), 1, fp);
+		render::catchUp();
+
+		// registers, counters and bank-switching state
+		const PPUSTATE& state=ppuState();
+		s.ppu.frameNum=state.frameNum;
+		s.ppu.lineStart=state.lineStart;
+		s.ppu.scanline=state.scanline;
+		for (int i=0;i<8;i++) s.ppu.chrBanks[i]=state.prevBankSrc[i];
+		s.ppu.latch=(uint32_t)state.latch;
+		s.ppu.scroll=(uint16_t)valueOf(state.scroll);
+		s.ppu.address=(uint16_t)valueOf(state.address);
+		s.ppu.tmpAddress=(uint16_t)valueOf(state.tmpAddress);
+		s.ppu.control=(uint8_t)valueOf(state.control);
+		s.ppu.mask=(uint8_t)valueOf(state.mask);
+		s.ppu.status=(uint8_t)valueOf(state.status);
+		s.ppu.oamAddr=(uint8_t)valueOf(state.oamAddr);
+		s.ppu.xoffset=(uint8_t)valueOf(state.xoffset);
+		s.ppu.firstWrite=state.firstWrite?1:0;
+		memset(s.ppu.reserved, 0, sizeof(s.ppu.reserved));
 
 		// memory
-		mem::save(fp);
+		mem::save(s);
 	}
 
-	void load(FILE *fp)
+	void load(const SNAPSHOT& s)
 	{
-		// registers
-		fread(&control, sizeof(control), 1, fp);
-		fread(&mask, sizeof(mask), 1, fp);
-		fread(&status, sizeof(status), 1, fp);
-
-		fread(&scroll, sizeof(scroll), 1, fp);
-		fread(&xoffset, sizeof(xoffset), 1, fp);
-		fread(&address, sizeof(address), 1, fp);
-
-		fread(&oamAddr, sizeof(oamAddr), 1, fp);
+		PPUSTATE& state=ppuState();
+		state.frameNum=s.ppu.frameNum;
+		state.lineStart=s.ppu.lineStart;
+		state.scanline=s.ppu.scanline;
+		for (int i=0;i<8;i++) state.prevBankSrc[i]=s.ppu.chrBanks[i];
+		state.latch=(byte_t)s.ppu.latch;
+		state.scroll.asBitField()=s.ppu.scroll;
+		state.address.asBitField()=s.ppu.address;
+		state.tmpAddress.asBitField()=s.ppu.tmpAddress;
+		state.control.asBitField()=s.ppu.control;
+		state.mask.asBitField()=s.ppu.mask;
+		state.status.asBitField()=s.ppu.status;
+		state.oamAddr=s.ppu.oamAddr;
+		state.xoffset=s.ppu.xoffset;
+		state.firstWrite=s.ppu.firstWrite!=0;
 
 		// memory
-		mem::load(fp);
+		mem::load(s);
+		render::invalidateSprites();
+		renderState().pendingScanline=-1;
 	}
 
 	void init()
@@ -896,11 +1289,12 @@ namespace ppu
 	{
 		data=INVALID;
 		vassert(1==valueOf(maddress)>>13); // [$2000,$4000)
+		render::catchUp();
 		switch (valueOf(maddress)&7)
 		{
 		case 2: // $2002 PPU Status Register
-			data=valueOf(status);
-			status.clear(PPUSTATUS::VBLANK);
+			data=valueOf(ppuState().status);
+			ppuState().status.clear(PPUSTATUS::VBLANK);
 			mem::resetToggle();
 			return true;
 		case 0: // $2000 PPU Control Register 1
@@ -910,7 +1304,7 @@ namespace ppu
 		case 6: // $2006 VRAM address
 			break; // The above are write-only registers.
 		case 4: // $2004 Sprite Memory Read
-			data=oamData(oamAddr);
+			data=oamData(ppuState().oamAddr);
 			return true;
 		case 7: // $2007 VRAM read
 			data=mem::read();
@@ -922,25 +1316,28 @@ namespace ppu
 	bool writePort(const maddr_t maddress, const byte_t data)
 	{
 		vassert(1==valueOf(maddress)>>13); // [$2000,$4000)
+		render::catchUp();
 		switch (valueOf(maddress)&7)
 		{
 		case 0: // $2000 PPU Control Register 1
-			if (!control[PPUCTRL::NMI_ENABLED] && (data&(byte_t)PPUCTRL::NMI_ENABLED) && status[PPUSTATUS::VBLANK])
+			if (!ppuState().control[PPUCTRL::NMI_ENABLED] && (data&(byte_t)PPUCTRL::NMI_ENABLED) && ppuState().status[PPUSTATUS::VBLANK])
 			{
 				// nmi should occur when enabled during VBlank
 				cpu::irq(IRQTYPE::NMI);
 			}
-			control1.asBitField()=data;
+			ppuState().control.asBitField()=data;
 			return true;
 		case 1: // $2001 PPU Control Register 2
-			control2.asBitField()=data;
+			ppuState().mask.asBitField()=data;
+			reschedule(); // rendering on/off starts or stops the mmc3 counter
 			return true;
 		case 3: // $2003 Sprite RAM address
-			oamAddr=data;
+			ppuState().oamAddr=data;
 			return true;
 		case 4: // $2004 Sprite Memory Data
-			oamData(oamAddr)=data;
-			inc(oamAddr);
+			oamData(ppuState().oamAddr)=data;
+			render::updateSprite(ppuState().oamAddr>>2);
+			inc(ppuState().oamAddr);
 			return true;
 		case 5: // $2005 Screen Scroll offsets
 			render::setScroll(data);
@@ -957,29 +1354,57 @@ namespace ppu
 		return false;
 	}
 
+	// cycles the cpu can run before the next scanline that needs hsync()
+	long cyclesToNextEvent()
+	{
+		const int lines=render::nextEventLine()-ppuState().scanline+1;
+		return (long)(ppuState().lineStart+(long long)lines*SCANLINE_CYCLES-cpu::cycleBudget());
+	}
+
+	// ends the scanlines the cpu was given cycles for, the last one being the event
 	bool hsync()
 	{
+		const int lines=(int)((cpu::cycleBudget()-ppuState().lineStart)/SCANLINE_CYCLES);
+		assert(lines>=1);
+		render::skipScanlines(lines-1);
+
 		#ifdef MONITOR_RENDERING
-			debug::printPPUState(frameNum, scanline, status[PPUSTATUS::VBLANK], status[PPUSTATUS::HIT], mask[PPUMASK::BG_VISIBLE], mask[PPUMASK::SPR_VISIBLE]);
+			debug::printPPUState(ppuState().frameNum, ppuState().scanline, ppuState().status[PPUSTATUS::VBLANK], ppuState().status[PPUSTATUS::HIT], ppuState().mask[PPUMASK::BG_VISIBLE], ppuState().mask[PPUMASK::SPR_VISIBLE]);
 		#endif
 		mapper::HBlank();
+		ppuState().lineStart+=SCANLINE_CYCLES;
 		return render::HBlank();
 	}
 
+	void catchUp()
+	{
+		render::catchUp();
+	}
+
+	// the cpu changed something the next event depends on, stop it there if that is sooner
+	void reschedule()
+	{
+		render::sync();
+		const int lines=render::nextEventLine()-ppuState().scanline+1;
+		cpu::limitCycleBudget(ppuState().lineStart+(long long)lines*SCANLINE_CYCLES);
+	}
+
 	void dma(const uint8_t* src)
 	{
 		assert(src!=nullptr);
-		memcpy(&oam, src, sizeof(oam));
+		render::catchUp();
+		memcpy(&emu::oam(), src, sizeof(emu::oam()));
+		render::invalidateSprites();
 	}
 
 	int currentScanline()
 	{
-		return scanline;
+		return ppuState().scanline;
 	}
 
 	long long currentFrame()
 	{
-		return frameNum;
+		return ppuState().frameNum;
 	}
 }
 
@@ -1017,29 +1442,17 @@ namespace pmapper
 		selectVROM(8, value, 0);
 	}
 
+	// the mapper has already been checked by mapper::setup()
 	bool setup()
 	{
-		switch (rom::mapperType())
-		{
-		case 0: // no mapper
-		case 1: // Mapper 1: MMC1
-		case 2: // Mapper 2: UNROM - PRG/16K
-		case 3: // Mapper 3: CNROM - VROM/8K
-		case 4: // MMC3 - PRG/8K, VROM/2K/1K, VT, SRAM, IRQ
-		case 7: // Mapper 7: AOROM - PRG/32K, Name Table Select
-			if (rom::sizeOfVROM()>=0x2000) // 8K of texture or more
-				mem::bankSwitch(0, 0, 8);
-			else if (rom::sizeOfVROM()>0)
-			{
-invalidVROMSize:
-				ERROR(INVALID_MEMORY_ACCESS, MAPPER_FAILURE, "vrom size", rom::sizeOfVROM(), "mapper", rom::mapperType());
-				return false;
-			}
-			return true;
+		if (rom::sizeOfVROM()>=0x2000) // 8K of texture or more
+			mem::bankSwitch(0, 0, 8);
+		else if (rom::sizeOfVROM()>0)
+		{
+			ERROR(INVALID_MEMORY_ACCESS, MAPPER_FAILURE, "vrom size", rom::sizeOfVROM(), "mapper", rom::mapperType());
+			return false;
 		}
-		// unknown mapper
-		FATAL_ERROR(INVALID_ROM, UNSUPPORTED_MAPPER_TYPE, "mapper", rom::mapperType());
-		return false;
+		return true;
 	}
 }
 
@@ -1055,15 +1468,80 @@ public:
 	virtual TestResult run()
 	{
 		puts("checking VRAM struture...");
-		tassert(sizeof(vram)==0x4000);
-		tassert(sizeof(vram.vrom.patternTables)==0x2000);
+		tassert(sizeof(emu::vram())==0x4000);
+		tassert(sizeof(emu::vram().vrom.patternTables)==0x2000);
 		tassert(ptr_diff(&vramAt(0).attribs[0],&vramData(0))==0x23C0);
 		tassert(ptr_diff(&vramNt(1).tiles[0][0],&vramData(0))==0x2400);
-		tassert(ptr_diff(&vram.pal,&vramData(0))==0x3F00);
-		tassert(sizeof(oam)==0x100);
+		tassert(ptr_diff(&emu::vram().pal,&vramData(0))==0x3F00);
+		tassert(sizeof(emu::oam())==0x100);
+
+		// chr-rom banks are mapped in place
+		emu::Machine* m=new emu::Machine();
+		{
+			emu::MachineScope scope(m);
+			tassert(mem::patternTile(1, 0)==&vramPt(1).tiles[0]);
 
-		printf("[ ] VRAM at 0x%p\n",&vram);
-		printf("[ ] SPR-RAM at 0x%p\n",&oam);
+			m->rom.chrCount=1;
+			m->rom.vromSize=0x2000;
+			m->rom.vromData=new char[0x2000];
+			for (int i=0;i<8;i++)
+				memset(m->rom.vromData+i*0x400, i, 0x400);
+
+			mem::bankSwitch(0, 0, 8);
+			tassert(mem::patternTile(0, 0x40)->colorD0[0]==1 && mem::patternTile(1, 0xFF)->colorD1[7]==7);
+			mem::bankSwitch(4, 2, 1);
+			tassert(ppuState().chrPages[4]==(const uint8_t*)m->rom.vromData+0x800);
+			tassert(mem::patternTile(1, 0x3F)->colorD0[0]==2);
+
+			// decoded rows follow the bank switch
+			tassert(mem::decodedTile(1, 0x3F)[0]==0x3000 && mem::decodedTile(0, 0x41)[0]==0xC000);
+			m->rom.vromData[0x800]=(char)0x80;
+			m->rom.vromData[0x808]=(char)0x01;
+			mem::bankSwitch(5, 2, 1);
+			tassert(mem::decodedTile(1, 0x40)[0]==0x8001 && mem::decodedTile(1, 0x40, true)[0]==0x4002);
+		}
+		delete m;
+
+		// scanline kernel
+		const uint16_t colorD0D1s[2]={0x8001, 0x00E4};
+		const uint8_t colorD2D3[2]={0x04, 0x0C};
+		uint8_t pixels[16], opaque[16];
+		render::expandTiles(colorD0D1s, colorD2D3, 2, pixels, opaque);
+		const uint8_t expectedPixels[16]={5,4,4,4,4,4,4,6, 12,13,14,15,12,12,12,12};
+		const uint8_t expectedOpaque[16]={1,0,0,0,0,0,0,1, 0,1,1,1,0,0,0,0};
+		tassert(memcmp(pixels, expectedPixels, 16)==0 && memcmp(opaque, expectedOpaque, 16)==0);
+		// both paths agree on a full scanline of tiles
+		uint16_t rows[34];
+		uint8_t attribs[34];
+		for (int i=0;i<34;i++)
+		{
+			rows[i]=(uint16_t)(i*0x9E37+0x1234);
+			attribs[i]=(uint8_t)((i&3)<<2);
+		}
+		uint8_t vectorPixels[34*8], vectorOpaque[34*8], scalarPixels[34*8], scalarOpaque[34*8];
+		render::expandTiles(rows, attribs, 34, vectorPixels, vectorOpaque);
+		render::expandTilesScalar(rows, attribs, 34, scalarPixels, scalarOpaque);
+		tassert(memcmp(vectorPixels, scalarPixels, sizeof(scalarPixels))==0 && memcmp(vectorOpaque, scalarOpaque, sizeof(scalarOpaque))==0);
+
+		// palette conversion, long enough for the vector loop and its tail
+		rgb32_t p32[32];
+		for (int i=0;i<32;i++) p32[i]=Rgb32(i, 0x80+i, 0xFF-i);
+		palindex_t indexes[21];
+		rgb32_t colors[21];
+		for (int i=0;i<21;i++) indexes[i]=(i*7)&31;
+		render::toRgb32(indexes, colors, 21, p32);
+		for (int i=0;i<21;i++) tassert(colors[i]==p32[(i*7)&31]);
+		rgb16_t p16[32], colors16[21];
+		for (int i=0;i<32;i++) p16[i]=Rgb16(p32[i]);
+		render::toRgb16(indexes, colors16, 21, p16);
+		for (int i=0;i<21;i++) tassert(colors16[i]==p16[(i*7)&31]);
+		uint8_t p8[32], colors8[21];
+		for (int i=0;i<32;i++) p8[i]=(uint8_t)(63-i);
+		render::toIndexed8(indexes, colors8, 21, p8);
+		for (int i=0;i<21;i++) tassert(colors8[i]==p8[(i*7)&31]);
+
+		printf("[ ] VRAM at 0x%p\n",&emu::vram());
+		printf("[ ] SPR-RAM at 0x%p\n",&emu::oam());
 		return SUCCESS;
 	}
 };
@@ -1136,5 +1614,305 @@ public:
 	}
 };
 
+class PPUSpriteTest : public TestCase
+{
+public:
+	virtual const char* name()
+	{
+		return "PPU Sprite Evaluation Test";
+	}
+
+	virtual TestResult run()
+	{
+		emu::Machine* m=new emu::Machine();
+		{
+			emu::MachineScope scope(m);
+			uint8_t sprites[0x100];
+			memset(sprites, 0xFF, sizeof(sprites)); // all below the screen
+			sprites[0]=9; // sprite 0 at y=10
+			sprites[4*5]=14; // sprite 5 at y=15
+			ppu::dma(sprites);
+			ppuState().mask|=PPUMASK::SPR_VISIBLE;
+
+			ppuState().scanline=12;
+			render::evaluateSprites();
+			tassert(renderState().pendingSpritesCount==1 && renderState().pendingSprites[0]==0);
+			ppuState().scanline=17;
+			render::evaluateSprites();
+			tassert(renderState().pendingSpritesCount==2 && renderState().pendingSprites[0]==0 && renderState().pendingSprites[1]==5);
+			ppuState().scanline=18;
+			render::evaluateSprites();
+			tassert(renderState().pendingSpritesCount==1 && renderState().pendingSprites[0]==5);
+
+			// lists follow the sprite height
+			ppuState().control|=PPUCTRL::LARGE_SPRITE;
+			render::evaluateSprites();
+			tassert(renderState().pendingSpritesCount==2);
+
+			// and OAM writes
+			ppu::writePort(maddr_t(0x2003), 0);
+			ppu::writePort(maddr_t(0x2004), 0xF0);
+			tassert(renderState().spriteY[0]==0xF0);
+			ppu::writePort(maddr_t(0x2004), 0x42);
+			ppu::writePort(maddr_t(0x2004), 0xE3);
+			ppu::writePort(maddr_t(0x2004), 0x80);
+			tassert(renderState().spriteTile[0]==0x42 && renderState().spriteAttr[0][SPRATTR::FLIP_V] && renderState().spriteAttr[0].select(SPRATTR::COLOR_HI)==3 && renderState().spriteX[0]==0x80);
+			render::evaluateSprites();
+			tassert(renderState().pendingSpritesCount==1 && renderState().pendingSprites[0]==5);
+
+			// sprites starting on the last scanline are still visible, the ones below are not
+			sprites[4*63]=render::RENDER_HEIGHT-2;
+			sprites[4*62]=render::RENDER_HEIGHT-1;
+			ppu::dma(sprites);
+			tassert(render::visibleSprites()==((uint64_t)1|((uint64_t)1<<5)|((uint64_t)1<<63)));
+		}
+		delete m;
+		return SUCCESS;
+	}
+};
+
+class PPUFrameSkipTest : public TestCase
+{
+public:
+	virtual const char* name()
+	{
+		return "PPU Frame Skip Test";
+	}
+
+	// fills chr-ram, name tables, oam and the registers with the same noise for each seed
+	static void randomize(unsigned seed)
+	{
+		uint8_t* bytes=&vramData(0);
+		for (int i=0;i<0x3000;i++)
+		{
+			seed=seed*1103515245+12345;
+			// keep tiles sparse so both opaque and transparent pixels show up
+			bytes[i]=(uint8_t)(seed>>16)&(uint8_t)(seed>>24);
+		}
+		mem::invalidateTiles();
+		uint8_t sprites[0x100];
+		for (int i=0;i<0x100;i++)
+		{
+			seed=seed*1103515245+12345;
+			sprites[i]=(uint8_t)(seed>>16);
+		}
+		ppu::dma(sprites);
+
+		ppuState().control.asBitField()=(seed>>8)&0x38;
+		ppuState().mask.asBitField()=0x18|((seed>>12)&0x06);
+		ppuState().scroll.asBitField()=(seed>>3)&ppuState().scroll.asBitField().MAX;
+		ppuState().address.asBitField()=(seed>>5)&ppuState().address.asBitField().MAX;
+		ppuState().xoffset=(seed>>20)&7;
+	}
+
+	virtual TestResult run()
+	{
+		emu::init();
+		emu::Machine* drawn=new emu::Machine();
+		emu::Machine* skipped=new emu::Machine();
+		for (unsigned seed=1;seed<=20;seed++)
+		{
+			{
+				emu::MachineScope scope(drawn);
+				randomize(seed);
+			}
+			{
+				emu::MachineScope scope(skipped);
+				randomize(seed);
+				renderState().skipCurrentFrame=true;
+			}
+			for (int line=0;line<render::RENDER_HEIGHT;line++)
+			{
+				bool hit[2];
+				int addr[2];
+				emu::Machine* machines[2]={drawn, skipped};
+				for (int i=0;i<2;i++)
+				{
+					emu::MachineScope scope(machines[i]);
+					ppuState().status-=PPUSTATUS::HIT;
+					ppuState().scanline=line;
+					render::renderScanline();
+					hit[i]=ppuState().status[PPUSTATUS::HIT];
+					addr[i]=valueOf(ppuState().address);
+				}
+				tassert(hit[0]==hit[1] && addr[0]==addr[1]);
+			}
+		}
+		delete skipped;
+		delete drawn;
+		return SUCCESS;
+	}
+};
+
+class PPUCatchUpTest : public TestCase
+{
+public:
+	virtual const char* name()
+	{
+		return "PPU Catch-up Rendering Test";
+	}
+
+	virtual TestResult run()
+	{
+		emu::Machine* m=new emu::Machine();
+		{
+			emu::MachineScope scope(m);
+			ppuState().mask|=PPUMASK::BG_VISIBLE;
+			render::enablePresent(false);
+
+			// the pre-render line and 10 visible lines pass without drawing
+			for (int i=0;i<11;i++)
+			{
+				cpu::run(0, SCANLINE_CYCLES);
+				ppu::hsync();
+			}
+			tassert(ppuState().scanline==10 && renderState().pendingScanline==0);
+			renderState().vBuffer[9][0]=31;
+
+			// until the cpu looks at the ppu
+			byte_t data;
+			ppu::readPort(maddr_t(0x2002), data);
+			tassert(renderState().pendingScanline==-1 && ppuState().scanline==10);
+			tassert(renderState().vBuffer[9][0]==0);
+
+			// the rest of the frame is drawn before vblank
+			while (ppuState().scanline<241)
+			{
+				cpu::run(0, SCANLINE_CYCLES);
+				ppu::hsync();
+			}
+			tassert(renderState().pendingScanline==-1 && ppuState().status[PPUSTATUS::VBLANK]);
+		}
+		delete m;
+		return SUCCESS;
+	}
+};
+
+class PPUSchedulerTest : public TestCase
+{
+public:
+	virtual const char* name()
+	{
+		return "PPU Event Scheduling Test";
+	}
+
+	// gives the cpu the cycles up to the next event without running anything
+	static bool nextEvent(const int lines)
+	{
+		const long cycles=ppu::cyclesToNextEvent();
+		if (cycles!=lines*SCANLINE_CYCLES) return false;
+		cpu::run(0, cycles);
+		return true;
+	}
+
+	virtual TestResult run()
+	{
+		emu::Machine* m=new emu::Machine();
+		{
+			emu::MachineScope scope(m);
+			render::enablePresent(false);
+
+			// pre-render, vblank start, vblank end and end of frame
+			tassert(nextEvent(1) && ppu::hsync() && ppuState().scanline==0);
+			tassert(nextEvent(241) && ppu::hsync() && ppuState().scanline==241);
+			tassert(ppuState().status[PPUSTATUS::VBLANK] && renderState().pendingScanline==-1);
+			tassert(nextEvent(20) && ppu::hsync() && ppuState().scanline==261);
+			tassert(nextEvent(1) && !ppu::hsync() && ppuState().scanline==-1);
+
+			// an mmc3 irq splits the visible lines
+			m->rom.mapper=4;
+			mapper::reset();
+			ppuState().mask|=PPUMASK::BG_VISIBLE;
+			m->mapper.board->write(maddr_t(0xC001), 10);
+			m->mapper.board->write(maddr_t(0xE001), 0);
+			tassert(nextEvent(1) && ppu::hsync() && m->mapper.mmc3Counter==10);
+			tassert(nextEvent(10) && ppu::hsync() && ppuState().scanline==10 && m->mapper.mmc3Counter==0);
+			tassert(nextEvent(231));
+
+			// moving the counter cuts the cpu run short
+			m->mapper.board->write(maddr_t(0xC000), 5);
+			tassert(cpu::cycleBudget()-ppuState().lineStart==5*SCANLINE_CYCLES);
+			m->mapper.board->write(maddr_t(0xE000), 0);
+			tassert(cpu::cycleBudget()-ppuState().lineStart==5*SCANLINE_CYCLES);
+			tassert(ppu::hsync() && ppuState().scanline==15 && nextEvent(226));
+		}
+		delete m;
+		return SUCCESS;
+	}
+};
+
+class PPUSprite0PollTest : public TestCase
+{
+public:
+	virtual const char* name()
+	{
+		return "PPU Sprite 0 Poll Test";
+	}
+
+	// opaque background everywhere and sprite 0 at (40,100), polled by the program below
+	static emu::Machine* newMachine(const bool jit)
+	{
+		static const uint8_t code[]={
+			0x2C,0x02,0x20, // $8000 BIT $2002
+			0x50,0xFB,      //       BVC $8000
+			0xA9,0x01,      //       LDA #1
+			0x85,0x00,      //       STA $00
+			0xE8,           // $8009 INX
+			0x4C,0x09,0x80, //       JMP $8009
+		};
+		emu::Machine* m=new emu::Machine();
+		loadTestProgram(*m, code, sizeof(code));
+		emu::MachineScope scope(m);
+		cpu::enableJIT(jit);
+		render::enablePresent(false);
+		memset(&vramData(0), 0xFF, 8); // tile 0 has color 1 on every pixel
+		mem::invalidateTiles();
+		uint8_t sprites[0x100];
+		memset(sprites, 0xFF, sizeof(sprites));
+		sprites[0]=99;
+		sprites[1]=0;
+		sprites[2]=0;
+		sprites[3]=40;
+		ppu::dma(sprites);
+		ppuState().mask|=PPUMASK::BG_VISIBLE;
+		ppuState().mask|=PPUMASK::SPR_VISIBLE;
+		return m;
+	}
+
+	virtual TestResult run()
+	{
+		emu::init();
+
+		// one hblank per scanline, the way frames used to run
+		emu::Machine* stepped=newMachine(false);
+		int hitLine=-2;
+		{
+			emu::MachineScope scope(stepped);
+			do
+			{
+				tassert(cpu::run(-1, SCANLINE_CYCLES));
+				if (hitLine==-2 && stepped->ram.bank0[0]==1) hitLine=ppuState().scanline;
+			}while (ppu::hsync());
+		}
+		tassert(hitLine==101);
+
+		for (int jit=0;jit<2;jit++)
+		{
+			emu::Machine* m=newMachine(jit!=0);
+			tassert(m->nextFrame());
+			// the loop left on the same cycle, so the counter after it ends up the same
+			tassert(m->ram.bank0[0]==1 && m->cpu.X==stepped->cpu.X && m->cpu.cycleCount==stepped->cpu.cycleCount);
+			delete m;
+		}
+		delete stepped;
+		return SUCCESS;
+	}
+};
+
 registerTestCase(PPUMemTest);
-registerTestCase(PPUMirroringTest);
\ No newline at end of file
+registerTestCase(PPUMirroringTest);
+registerTestCase(PPUCatchUpTest);
+registerTestCase(PPUSchedulerTest);
+registerTestCase(PPUSpriteTest);
+registerTestCase(PPUFrameSkipTest);
+registerTestCase(PPUSprite0PollTest);
\ No newline at end of file
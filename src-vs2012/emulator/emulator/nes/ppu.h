@@ -118,22 +118,10 @@ struct NESVRAM
 			uint8_t lookup(const int tileRow, const int tileCol) const
 			{
 				vassert((unsigned)tileRow<30 && (unsigned)tileCol<32);
-				byte_t value=attribs[((tileRow>>2)<<3)+(tileCol>>2)];
-				switch ((((tileRow&3)>>1)<<1)|(tileCol&3)>>1)
-				{
-					case 0:
-						value<<=2;
-						break;
-					case 1:
-						break;
-					case 2:
-						value>>=2;
-						break;
-					case 3:
-						value>>=4;
-						break;
-				}
-				return value&0x0C;
+				const byte_t value=attribs[((tileRow>>2)<<3)+(tileCol>>2)];
+				// each 2x2 tile quadrant owns 2 bits, top left quadrant in the lowest bits
+				const int shift=((tileRow&2)<<1)|(tileCol&2);
+				return ((value>>shift)<<2)&0x0C;
 			}
 		}attribTable;
 	}nameTables[4];
@@ -173,17 +161,96 @@ public:
 	}
 };
 
-extern struct NESVRAM vram;
-extern struct NESOAM oam;
+// PPU VRAM Access Registers
+typedef flag_set<_addr15_t, PPUADDR, 15> scroll_flag_t;
+typedef flag_set<_addr14_t, PPUADDR, 14> vaddr_flag_t;
 
-#define vramPt(ptindex) vram.vrom.patternTables[ptindex]
-#define vramNt(ntindex) vram.nameTables[ntindex].nameTable
-#define vramAt(ntindex) vram.nameTables[ntindex].attribTable
-#define vramData(offset) vram.data(offset)
-#define oamData(offset) oam.data(offset)
+// registers and counters of the ppu
+struct PPUSTATE
+{
+	// PPU Control & Status Registers
+	flag_set<_reg8_t, PPUCTRL, 8> control; // $2000
+	flag_set<_reg8_t, PPUMASK, 8> mask; // $2001
+	flag_set<_reg8_t, PPUSTATUS, 8> status; // $2002
+
+	// PPU SPR-RAM Access Registers
+	saddr_t oamAddr; // $2003
+
+	// PPU VRAM Access Registers
+	scroll_flag_t scroll; // $2005 Background Scrolling Offset / Reload register
+	offset3_t xoffset;
+	vaddr_flag_t address; // $2006 VRAM Address Register / Scrolling Pointer
+	vaddr_flag_t tmpAddress; // debug only
+
+	// PPU counters
+	int scanline;
+	long long frameNum;
+	long long lineStart; // cpu cycle budget at the start of the current scanline
+
+	// addresses of currently selected VROM banks.
+	int prevBankSrc[8];
+	// 1K pattern table pages, pointing into the CHR-ROM image or into vram for CHR-RAM.
+	const uint8_t* chrPages[8];
+
+	// shared for both port $2005 and $2006
+	bool firstWrite;
+	// $2007 Read/Write Data Register
+	byte_t latch;
+};
 
-#define oamSprite(index) oam.sprite(index)
-#define colorIdx(index) vram.colorIndex(index)
+namespace render
+{
+	const int RENDER_WIDTH=256;
+	const int RENDER_HEIGHT=240;
+}
+
+// pattern rows of a 1K CHR page decoded to 2 bits per pixel, leftmost pixel in the lowest bits
+struct DECODEDCHR
+{
+	uint16_t rows[2][64][8]; // [horizontally flipped][tile][row]
+	const uint8_t* source; // page the rows were decoded from, nullptr when stale
+};
+
+// frame buffers and per-scanline work area of the renderer
+struct RENDERSTATE
+{
+	palindex_t vBuffer[render::RENDER_HEIGHT][render::RENDER_WIDTH];
+	rgb32_t vBuffer32[SCREEN_HEIGHT*SCREEN_WIDTH];
+
+	int8_t pendingSprites[64];
+	int pendingSpritesCount;
+
+	// struct-of-arrays copy of oam for the range checks and the sprite drawing loops
+	uint8_t spriteY[64]; // y coordinate - 1
+	uint8_t spriteTile[64];
+	flag_set<uint8_t, SPRATTR> spriteAttr[64];
+	uint8_t spriteX[64];
+
+	// sprites in y range of each scanline, rebuilt when OAM or the sprite height changes
+	int8_t scanlineSprites[render::RENDER_HEIGHT][64];
+	uint8_t scanlineSpriteCount[render::RENDER_HEIGHT];
+	int spriteListHeight; // sprite height the lists were built for, 0 when stale
+	bool solidPixel[render::RENDER_WIDTH];
+	bool spritePixel[render::RENDER_WIDTH];
+
+	DECODEDCHR tileCache[8]; // one per mapped CHR page
+
+	bool presentFrames; // hand finished frames over to the ui
+	int pendingScanline; // first visible scanline the cpu has run past without it being drawn, -1 if none
+	int frameSkip; // frames skipped after each drawn one
+	bool skipCurrentFrame; // no pixels are generated for this frame
+};
+
+#define vramPt(ptindex) emu::vram().vrom.patternTables[ptindex]
+#define vramNt(ntindex) emu::vram().nameTables[ntindex].nameTable
+#define vramAt(ntindex) emu::vram().nameTables[ntindex].attribTable
+#define vramData(offset) emu::vram().data(offset)
+#define oamData(offset) emu::oam().data(offset)
+
+#define oamSprite(index) emu::oam().sprite(index)
+#define colorIdx(index) emu::vram().colorIndex(index)
+
+struct SNAPSHOT;
 
 namespace ppu
 {
@@ -196,14 +263,17 @@ namespace ppu
 
 	void dma(const uint8_t* src);
 
+	long cyclesToNextEvent();
 	bool hsync();
+	void catchUp();
+	void reschedule();
 
 	int currentScanline();
 	long long currentFrame();
 
 	// save state
-	void save(FILE *fp);
-	void load(FILE *fp);
+	void save(SNAPSHOT& s);
+	void load(const SNAPSHOT& s);
 }
 
 namespace pmapper
@@ -221,4 +291,7 @@ namespace render
 {
 	bool enabled();
 	bool leftClipped();
+
+	void enablePresent(const bool enable);
+	void setFrameSkip(const int frames);
 }
\ No newline at end of file
@@ -0,0 +1,340 @@
+#include "../stdafx.h"
+
+// local header files
+#include "../macros.h"
+#include "../types/types.h"
+#include "../unittest/framework.h"
+
+#include "internals.h"
+#include "debug.h"
+#include "rom.h"
+#include "opcodes.h"
+#include "mmc.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "emu.h"
+#include "rewind.h"
+#include "testrom.h"
+
+// Coding of the xor of two snapshots, where between two frames almost every byte is zero
+// and the rest are scattered over ram and the cpu and ppu registers.
+// Each run of zeros and the bytes that follow it become one token:
+//
+//	zzzzllll [zeros-15] [literals-15] <literals>
+//
+// a nibble of 15 means the count goes on in the following varint (7 bits a byte, low bits first).
+// a literal run only ends at two zero bytes in a row, and zeros at the end aren't coded at all.
+namespace delta
+{
+	static const size_t SHORT_RUN=15;
+
+	// largest output for size bytes of input
+	static size_t bound(const size_t size)
+	{
+		return size+size/4+16;
+	}
+
+	static size_t putCount(size_t count, uint8_t out[])
+	{
+		size_t o=0;
+		while (count>=0x80)
+		{
+			out[o++]=(uint8_t)(count|0x80);
+			count>>=7;
+		}
+		out[o++]=(uint8_t)count;
+		return o;
+	}
+
+	static size_t getCount(const uint8_t in[], size_t& i)
+	{
+		size_t count=0;
+		for (int shift=0;;shift+=7)
+		{
+			const uint8_t c=in[i++];
+			count|=(size_t)(c&0x7F)<<shift;
+			if (!(c&0x80)) return count;
+		}
+	}
+
+	// codes a^b into out, returns the bytes written
+	static size_t encode(const uint8_t a[], const uint8_t b[], const size_t size, uint8_t out[])
+	{
+		size_t i=0, o=0;
+		for (;;)
+		{
+			const size_t start=i;
+			while (i<size && a[i]==b[i]) i++;
+			if (i==size) break;
+			const size_t zeros=i-start;
+
+			const size_t first=i;
+			while (i<size && !(a[i]==b[i] && (i+1==size || a[i+1]==b[i+1]))) i++;
+			const size_t literals=i-first;
+
+			out[o++]=(uint8_t)((min(zeros, SHORT_RUN)<<4)|min(literals, SHORT_RUN));
+			if (zeros>=SHORT_RUN) o+=putCount(zeros-SHORT_RUN, out+o);
+			if (literals>=SHORT_RUN) o+=putCount(literals-SHORT_RUN, out+o);
+			for (size_t j=first;j<i;j++) out[o++]=a[j]^b[j];
+		}
+		return o;
+	}
+
+	// applies coded differences to data in place
+	static void decode(const uint8_t in[], const size_t size, uint8_t data[])
+	{
+		size_t i=0, o=0;
+		while (i<size)
+		{
+			const uint8_t c=in[i++];
+			size_t zeros=c>>4;
+			size_t literals=c&0x0F;
+			if (zeros==SHORT_RUN) zeros+=getCount(in, i);
+			if (literals==SHORT_RUN) literals+=getCount(in, i);
+
+			o+=zeros;
+			for (;literals>0;literals--) data[o++]^=in[i++];
+		}
+	}
+}
+
+namespace emu
+{
+	RewindBuffer::RewindBuffer(size_t capacity, int interval):
+		_capacity(capacity), _interval(max(interval, 1)),
+		_newest(new SNAPSHOT()), _newestFrame(0), _next(new SNAPSHOT()),
+		_ring(new uint8_t[capacity]), _head(0), _tail(0), _used(0), _entries(0),
+		_coded(new uint8_t[delta::bound(sizeof(SNAPSHOT))])
+	{
+		clear();
+	}
+
+	RewindBuffer::~RewindBuffer()
+	{
+		delete[] _coded;
+		delete[] _ring;
+		delete _next;
+		delete _newest;
+	}
+
+	void RewindBuffer::capture(Machine& machine)
+	{
+		const long long frame=machine.frameCount();
+		if (count()>0 && frame>=_newestFrame && frame-_newestFrame<_interval) return;
+
+		machine.snapshot(*_next);
+		if (count()>0)
+		{
+			// what it takes to get back from the new snapshot to the current newest
+			push(delta::encode((const uint8_t*)_newest, (const uint8_t*)_next, sizeof(SNAPSHOT), _coded));
+		}
+		SNAPSHOT* const previous=_newest;
+		_newest=_next;
+		_next=previous;
+		_newestFrame=frame;
+	}
+
+	bool RewindBuffer::stepBack(Machine& machine)
+	{
+		if (_entries==0) return false;
+
+		const size_t size=pop();
+		delta::decode(_coded, size, (uint8_t*)_newest);
+		if (!machine.restore(*_newest))
+		{
+			clear();
+			return false;
+		}
+		_newestFrame=machine.frameCount();
+		return true;
+	}
+
+	void RewindBuffer::clear()
+	{
+		_newest->version=0;
+		_head=_tail=_used=0;
+		_entries=0;
+	}
+
+	int RewindBuffer::count() const
+	{
+		if (_newest->version==0) return 0;
+		return _entries+1;
+	}
+
+	size_t RewindBuffer::used() const
+	{
+		return _used;
+	}
+
+	// appends the entry in _coded, making room by dropping the oldest ones
+	void RewindBuffer::push(size_t size)
+	{
+		const uint32_t header=(uint32_t)size;
+		const size_t total=size+2*sizeof(header);
+		if (total>_capacity)
+		{
+			// no room for even one entry, history starts over
+			_head=_tail=_used=0;
+			_entries=0;
+			return;
+		}
+		while (_capacity-_used<total) dropOldest();
+
+		put(&header, sizeof(header));
+		put(_coded, size);
+		put(&header, sizeof(header));
+		_used+=total;
+		_entries++;
+	}
+
+	// removes the newest entry into _coded, returns its size
+	size_t RewindBuffer::pop()
+	{
+		uint32_t header;
+		get((_head+_capacity-sizeof(header))%_capacity, &header, sizeof(header));
+		const size_t total=header+2*sizeof(header);
+		_head=(_head+_capacity-total)%_capacity;
+		get((_head+sizeof(header))%_capacity, _coded, header);
+		_used-=total;
+		_entries--;
+		return header;
+	}
+
+	void RewindBuffer::dropOldest()
+	{
+		uint32_t header;
+		get(_tail, &header, sizeof(header));
+		const size_t total=header+2*sizeof(header);
+		_tail=(_tail+total)%_capacity;
+		_used-=total;
+		_entries--;
+	}
+
+	// copies to the ring at _head, wrapping around its end
+	void RewindBuffer::put(const void* src, size_t size)
+	{
+		const size_t first=min(size, _capacity-_head);
+		memcpy(_ring+_head, src, first);
+		memcpy(_ring, (const uint8_t*)src+first, size-first);
+		_head=(_head+size)%_capacity;
+	}
+
+	void RewindBuffer::get(size_t pos, void* dst, size_t size) const
+	{
+		const size_t first=min(size, _capacity-pos);
+		memcpy(dst, _ring+pos, first);
+		memcpy((uint8_t*)dst+first, _ring, size-first);
+	}
+}
+
+// unit tests
+class RewindTest : public TestCase
+{
+public:
+	virtual const char* name()
+	{
+		return "Rewind Unit Test";
+	}
+
+	bool roundTrip(const uint8_t a[], const uint8_t b[], const size_t size)
+	{
+		uint8_t* coded=new uint8_t[delta::bound(size)];
+		uint8_t* data=new uint8_t[size];
+		const size_t codedSize=delta::encode(a, b, size, coded);
+		memcpy(data, a, size);
+		delta::decode(coded, codedSize, data);
+		const bool same=codedSize<=delta::bound(size) && memcmp(data, b, size)==0;
+		delete[] data;
+		delete[] coded;
+		return same;
+	}
+
+	// 16K cartridge that counts frames in ram: LDA #$80; STA $2000; INC $10; JMP $8005, nmi: INC $11; RTI
+	static emu::Machine* createMachine()
+	{
+		static const uint8_t code[]={0xA9, 0x80, 0x8D, 0x00, 0x20, 0xE6, 0x10, 0x4C, 0x05, 0x80, 0xE6, 0x11, 0x40};
+		emu::Machine* m=new emu::Machine();
+		loadTestProgram(*m, code, sizeof(code), 0x800A);
+		return m;
+	}
+
+	virtual TestResult run()
+	{
+		// coding of differences
+		const size_t size=1000;
+		uint8_t a[size], b[size];
+		for (size_t i=0;i<size;i++) a[i]=(uint8_t)(i*7);
+		memcpy(b, a, size);
+		tassert(roundTrip(a, b, size));
+		for (size_t i=0;i<size;i++) b[i]=~a[i];
+		tassert(roundTrip(a, b, size));
+		for (size_t i=0;i<size;i++) b[i]=(i%3==0)?a[i]:~a[i];
+		tassert(roundTrip(a, b, size));
+		memcpy(b, a, size);
+		b[0]^=1; b[15]^=1; b[16]^=1; b[200]^=1; b[size-1]^=1;
+		tassert(roundTrip(a, b, size));
+		for (size_t i=300;i<700;i++) b[i]^=0x55;
+		tassert(roundTrip(a, b, size));
+
+		// tests run before the emulator is initialized
+		emu::init();
+
+		// every step back lands on the snapshot taken at that frame
+		emu::Machine* m=createMachine();
+		emu::RewindBuffer* history=new emu::RewindBuffer(0x10000, 2);
+		SNAPSHOT* taken[10];
+		for (int i=0;i<10;i++)
+		{
+			tassert(m->nextFrame() && m->nextFrame());
+			history->capture(*m);
+			tassert(history->count()==i+1);
+			taken[i]=new SNAPSHOT();
+			m->snapshot(*taken[i]);
+		}
+		tassert(m->nextFrame());
+		history->capture(*m); // too early
+		tassert(history->count()==10);
+
+		SNAPSHOT* s=new SNAPSHOT();
+		for (int i=8;i>=0;i--)
+		{
+			tassert(history->stepBack(*m));
+			m->snapshot(*s);
+			tassert(m->frameCount()==2*(i+1));
+			tassert(memcmp(s->cpuRam, taken[i]->cpuRam, sizeof(s->cpuRam))==0);
+			tassert(memcmp(&s->ppu, &taken[i]->ppu, sizeof(s->ppu))==0);
+			tassert(s->cpu.cycleCount==taken[i]->cpu.cycleCount);
+		}
+		tassert(!history->stepBack(*m));
+		tassert(history->count()==1 && history->used()==0);
+
+		// a full ring drops the oldest snapshots
+		emu::RewindBuffer* small=new emu::RewindBuffer(256, 1);
+		for (int i=0;i<100;i++)
+		{
+			tassert(m->nextFrame());
+			small->capture(*m);
+			tassert(small->used()<=256);
+		}
+		const int kept=small->count();
+		tassert(kept>1 && kept<100);
+		for (int i=1;i<kept;i++)
+		{
+			tassert(small->stepBack(*m));
+		}
+		tassert(!small->stepBack(*m));
+		tassert(m->frameCount()==2+100-kept+1);
+		m->snapshot(*s);
+		tassert(s->cpuRam[0x11]==(uint8_t)m->frameCount()); // nmi counter is back in step
+
+		delete small;
+		delete s;
+		for (int i=0;i<10;i++) delete taken[i];
+		delete history;
+		delete m;
+		return SUCCESS;
+	}
+};
+
+registerTestCase(RewindTest);
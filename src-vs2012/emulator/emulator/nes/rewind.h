@@ -0,0 +1,53 @@
+namespace emu
+{
+	// history kept while playing: 4 MB hold 10 minutes or more of most games
+	const size_t REWIND_CAPACITY=4*1024*1024;
+	const int REWIND_INTERVAL=4; // frames
+
+	// history of a machine to step backwards through, in a ring of fixed size.
+	// the newest snapshot is kept whole, each older one only as the bytes that differ from the next (xor), see delta in rewind.cpp.
+	class RewindBuffer
+	{
+	public:
+		// capacity: bytes for the coded history, interval: frames between two snapshots
+		RewindBuffer(size_t capacity, int interval);
+		~RewindBuffer();
+
+		// takes a snapshot once interval frames have passed since the newest one, to be called between frames
+		void capture(Machine& machine);
+		// drops the newest snapshot and puts the machine back to the one before it, false when there is none
+		bool stepBack(Machine& machine);
+		void clear();
+
+		int count() const; // snapshots held
+		size_t used() const; // bytes of coded history
+
+	private:
+		void push(size_t size);
+		size_t pop();
+		void dropOldest();
+		void put(const void* src, size_t size);
+		void get(size_t pos, void* dst, size_t size) const;
+
+		const size_t _capacity;
+		const int _interval;
+
+		// newest snapshot and the frame it was taken at
+		SNAPSHOT* _newest;
+		long long _newestFrame;
+		SNAPSHOT* _next;
+
+		// ring of [size][coded difference][size] entries, oldest at _tail
+		uint8_t* _ring;
+		size_t _head;
+		size_t _tail;
+		size_t _used;
+		int _entries;
+
+		uint8_t* _coded; // one entry while it's coded or decoded
+
+	private:
+		RewindBuffer(const RewindBuffer&);
+		RewindBuffer& operator =(const RewindBuffer&);
+	};
+}
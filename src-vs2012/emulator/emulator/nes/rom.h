@@ -22,6 +22,22 @@ enum class ROMCONTROL2 {
     MAPPERHIGH=0xF0
 };
 
+// cartridge loaded into a machine
+struct ROMSTATE
+{
+	MIRRORING mirroring;
+	uint8_t mapper;
+	uint8_t prgCount, chrCount;
+	flag_set<uint8_t,ROMCONTROL1> romCtrl;
+	flag_set<uint8_t,ROMCONTROL2> romCtrl2;
+	char *trainerData;
+	size_t trainerSize;
+	char *imageData;
+	size_t imageSize;
+	char *vromData;
+	size_t vromSize;
+};
+
 // global functions
 namespace rom
 {
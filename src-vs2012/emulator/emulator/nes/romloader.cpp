@@ -8,18 +8,16 @@
 #include "internals.h"
 #include "debug.h"
 #include "rom.h"
+#include "mmc.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "emu.h"
 
-static MIRRORING mirroring;
-static uint8_t mapper;
-static uint8_t prgCount, chrCount;
-static flag_set<uint8_t,ROMCONTROL1> romCtrl;
-static flag_set<uint8_t,ROMCONTROL2> romCtrl2;
-static char *trainerData;
-static size_t trainerSize;
-static char *imageData;
-static size_t imageSize;
-static char *vromData;
-static size_t vromSize;
+// cartridge of the active machine
+static FORCE_INLINE ROMSTATE& romState()
+{
+	return emu::active().rom;
+}
 
 namespace rom
 {
@@ -47,44 +45,47 @@ namespace rom
 
 		puts("[-] loading...");
 
-		fread(&prgCount,1,1,fp);
-		fread(&chrCount,1,1,fp);
-		fread(&romCtrl,1,1,fp);
-		fread(&romCtrl2,1,1,fp);
+		// drop the previous cartridge
+		unload();
+
+		fread(&romState().prgCount,1,1,fp);
+		fread(&romState().chrCount,1,1,fp);
+		fread(&romState().romCtrl,1,1,fp);
+		fread(&romState().romCtrl2,1,1,fp);
 		fread(&reserved,8,1,fp);
 
-		printf("[ ] %u * 16K ROM Banks\n", prgCount);
-		printf("[ ] %u * 8K CHR Banks\n", chrCount);
-		printf("[ ] ROM Control Byte #1 : %u\n", valueOf(romCtrl));
-		printf("[ ] ROM Control Byte #2 : %u\n", valueOf(romCtrl2));
+		printf("[ ] %u * 16K ROM Banks\n", romState().prgCount);
+		printf("[ ] %u * 8K CHR Banks\n", romState().chrCount);
+		printf("[ ] ROM Control Byte #1 : %u\n", valueOf(romState().romCtrl));
+		printf("[ ] ROM Control Byte #2 : %u\n", valueOf(romState().romCtrl2));
 
-		mapper=romCtrl(ROMCONTROL1::MAPPERLOW);
-		mapper|=romCtrl2(ROMCONTROL2::MAPPERHIGH)<<4;
-		printf("[ ] Mapper : #%u\n",mapper);
+		romState().mapper=romState().romCtrl(ROMCONTROL1::MAPPERLOW);
+		romState().mapper|=romState().romCtrl2(ROMCONTROL2::MAPPERHIGH)<<4;
+		printf("[ ] Mapper : #%u\n",romState().mapper);
 
-		mirroring=romCtrl[ROMCONTROL1::VERTICALM]?MIRRORING::VERTICAL:MIRRORING::HORIZONTAL;
-		if (romCtrl[ROMCONTROL1::FOURSCREEN]) mirroring=MIRRORING::FOURSCREEN;
+		romState().mirroring=romState().romCtrl[ROMCONTROL1::VERTICALM]?MIRRORING::VERTICAL:MIRRORING::HORIZONTAL;
+		if (romState().romCtrl[ROMCONTROL1::FOURSCREEN]) romState().mirroring=MIRRORING::FOURSCREEN;
 
-		printf("[ ] Mirroring type : %u\n", mirroring);
-		printf("[ ] Fourscreen mode : %u\n", romCtrl[ROMCONTROL1::FOURSCREEN]);
-		printf("[ ] Trainer data present : %u\n", romCtrl[ROMCONTROL1::TRAINER]);
-		printf("[ ] SRAM present : %u\n", romCtrl[ROMCONTROL1::BATTERYPACK]);
+		printf("[ ] Mirroring type : %u\n", romState().mirroring);
+		printf("[ ] Fourscreen mode : %u\n", romState().romCtrl[ROMCONTROL1::FOURSCREEN]);
+		printf("[ ] Trainer data present : %u\n", romState().romCtrl[ROMCONTROL1::TRAINER]);
+		printf("[ ] SRAM present : %u\n", romState().romCtrl[ROMCONTROL1::BATTERYPACK]);
     
 		// read trainer data (if present)
-		if (romCtrl[ROMCONTROL1::TRAINER])
+		if (romState().romCtrl[ROMCONTROL1::TRAINER])
 		{
-			trainerSize = 512;
-			trainerData = new char[trainerSize];
-			assert(trainerData != NULL);
-			if (1 != fread(trainerData, 512, 1, fp)) goto incomplete;
+			romState().trainerSize = 512;
+			romState().trainerData = new char[romState().trainerSize];
+			assert(romState().trainerData != NULL);
+			if (1 != fread(romState().trainerData, 512, 1, fp)) goto incomplete;
 		}
 
 		puts("[ ] reading ROM image...");
 		// read rom image
-		imageSize = prgCount*0x4000;
-		imageData = new char[imageSize];
-		assert(imageData != NULL);
-		if (prgCount != fread(imageData, 0x4000, prgCount, fp))
+		romState().imageSize = romState().prgCount*0x4000;
+		romState().imageData = new char[romState().imageSize];
+		assert(romState().imageData != NULL);
+		if (romState().prgCount != fread(romState().imageData, 0x4000, romState().prgCount, fp))
 		{
 	incomplete:
 			ERROR(INVALID_ROM, UNEXPECTED_END_OF_FILE);
@@ -95,10 +96,10 @@ namespace rom
 
 		puts("[ ] reading VROM data...");
 		// read VROM
-		vromSize = chrCount*0x2000;
-		vromData = new char[vromSize];
-		assert(vromData != NULL);
-		if (chrCount != fread(vromData, 0x2000, chrCount, fp)) goto incomplete;
+		romState().vromSize = romState().chrCount*0x2000;
+		romState().vromData = new char[romState().vromSize];
+		assert(romState().vromData != NULL);
+		if (romState().chrCount != fread(romState().vromData, 0x2000, romState().chrCount, fp)) goto incomplete;
 
 		// done. close file
 		fclose(fp);
@@ -108,63 +109,66 @@ namespace rom
 
 	void unload()
 	{
-		SAFE_DELETE(trainerData);
-		SAFE_DELETE(imageData);
-		SAFE_DELETE(vromData);
+		cpu::flushCodeCache();
+		SAFE_DELETE(romState().trainerData);
+		SAFE_DELETE(romState().imageData);
+		SAFE_DELETE(romState().vromData);
 	}
 
 	int mapperType()
 	{
-		return mapper;
+		return romState().mapper;
 	}
 
 	MIRRORING mirrorMode()
 	{
-		return mirroring;
+		return romState().mirroring;
 	}
 
 	void setMirrorMode(MIRRORING newMode)
 	{
-		mirroring = newMode;
+		// scanlines already run are drawn with the old mirroring
+		ppu::catchUp();
+		romState().mirroring = newMode;
 	}
 
 	const char* getImage()
 	{
-		return imageData;
+		return romState().imageData;
 	}
 
 	const char* getVROM()
 	{
-		return vromData;
+		return romState().vromData;
 	}
 
 	size_t sizeOfImage()
 	{
-		return imageSize;
+		return romState().imageSize;
 	}
 
 	int count16KPRG()
 	{
-		return prgCount;
+		return romState().prgCount;
 	}
 
 	int count8KPRG()
 	{
-		return prgCount*2;
+		return romState().prgCount*2;
 	}
 
 	size_t sizeOfVROM()
 	{
-		return vromSize;
+		return romState().vromSize;
 	}
 
 	int count8KCHR()
 	{
-		return chrCount;
+		return romState().chrCount;
 	}
 
 	int count4KCHR()
 	{
-		return chrCount*2;
+		return romState().chrCount*2;
 	}
 }
\ No newline at end of file
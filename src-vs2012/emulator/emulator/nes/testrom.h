@@ -0,0 +1,23 @@
+// cartridge built in memory for the unit tests of the emulator core
+
+// 16K cartridge: code at $8000 (mirrored at $C000) followed by NOPs,
+// reset vector at $8000 and nmi vector at nmi unless it's 0
+inline void loadTestProgram(emu::Machine& machine, const uint8_t code[], const size_t size, const uint16_t nmi=0)
+{
+	vassert(size<=0x3FFA);
+	emu::MachineScope scope(&machine);
+	ROMSTATE& rom=machine.rom;
+	rom.prgCount=1;
+	rom.imageSize=0x4000;
+	rom.imageData=new char[0x4000];
+	memset(rom.imageData, 0xEA, 0x4000);
+	memcpy(rom.imageData, code, size);
+	if (nmi!=0)
+	{
+		rom.imageData[0x3FFA]=(char)(nmi&0xFF);
+		rom.imageData[0x3FFB]=(char)(nmi>>8);
+	}
+	rom.imageData[0x3FFC]=0x00;
+	rom.imageData[0x3FFD]=(char)0x80;
+	mmc::bankSwitch(0, 1, 0, 1);
+}
@@ -5,17 +5,27 @@
 
 #pragma once
 
-#include "targetver.h"
+#ifdef _WIN32
+	#include "targetver.h"
+#endif
 
 #define _CRT_SECURE_NO_WARNINGS
 #include <stdio.h>
-#include <tchar.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <errno.h>
 
-#include <intrin.h>
+#ifdef _MSC_VER
+	#include <tchar.h>
+#else
+	// narrow character strings only
+	typedef char _TCHAR;
+	#define _T(x) x
+	#define _tprintf printf
+	#define _tfopen_s(pfp, name, mode) ((*(pfp)=fopen((name), (mode)))==nullptr?errno:0)
+#endif
 
 // TODO: reference additional headers your program requires here
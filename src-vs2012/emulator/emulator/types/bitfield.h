@@ -1,6 +1,9 @@
 template <typename T, int bits>
 // integral type of known, fixed bit-width
 class bit_field: public value_object<T> {
+protected:
+	using value_object<T>::_value;
+
 public:
 	enum :T
 	{
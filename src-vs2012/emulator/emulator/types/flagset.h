@@ -1,6 +1,9 @@
 template <typename T, typename ET, int bits=SIZE_IN_BITS(T)>
 //  integral type that represents a set of flags
 class flag_set: public value_object<T> {
+protected:
+	using value_object<T>::_value;
+
 public:
 	enum :T
 	{
@@ -9,7 +12,7 @@ public:
 
 public:
 	// default ctor
-	flag_set():value_object(0) {} // value initialized to zero
+	flag_set():value_object<T>(0) {} // value initialized to zero
 
 	// bit field converter
 	bit_field<T,bits>& asBitField()
@@ -30,7 +33,7 @@ public:
 	}
 
 	// safe auto boxing
-	flag_set(const bit_field<T,bits>& rhs):value_object(0)
+	flag_set(const bit_field<T,bits>& rhs):value_object<T>(0)
 	{
 		_value=valueOf(rhs);
 	}
@@ -25,8 +25,8 @@ public:
 	transparent_value_object(const VT& value) {}
 
 	// transparent value getter
-	operator const VT&() const {return _value;}
+	operator const VT&() const {return this->_value;}
 
 	// transparent value setter
-	transparent_value_object& operator = (const value_object& other) {_value = other._value}
+	transparent_value_object& operator = (const value_object<VT, DT>& other) {this->_value = valueOf(other); return *this;}
 };
\ No newline at end of file
@@ -6,6 +6,10 @@
 #include "unittest/framework.h"
 
 #include "nes/internals.h"
+#include "nes/rom.h"
+#include "nes/mmc.h"
+#include "nes/cpu.h"
+#include "nes/ppu.h"
 #include "nes/emu.h"
 #include "ui.h"
 #include "kfw.h"
@@ -227,8 +231,10 @@ namespace ui
 			if (fp!=nullptr)
 			{
 				ui::reset(); // necessary
-				emu::loadState(fp);
-				puts("State loaded");
+				if (emu::loadState(fp))
+					puts("State loaded");
+				else
+					puts("State is from another version");
 				fclose(fp);
 			}else
 			{
@@ -293,4 +299,14 @@ namespace ui
 	{
 		return quitRequired;
 	}
+
+	// while backspace is held
+	bool rewindRequired()
+	{
+#ifdef WANT_DX9
+		return dx9render::keyDown(VK_BACK);
+#else
+		return (GetAsyncKeyState(VK_BACK)&0x8000)!=0;
+#endif
+	}
 }
\ No newline at end of file
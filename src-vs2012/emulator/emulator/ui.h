@@ -25,6 +25,7 @@ namespace ui
 	bool isForeground();
 
 	bool forceTerminate();
+	bool rewindRequired();
 
 	void limitFPS();
 
@@ -0,0 +1,84 @@
+#include "stdafx.h"
+
+// local header files
+#include "macros.h"
+#include "ui.h"
+
+// null ui backend for headless builds: no video output, no input and no frame rate limit
+namespace ui
+{
+	void init()
+	{
+	}
+
+	void deinit()
+	{
+	}
+
+	void reset()
+	{
+	}
+
+	void blt32(const uint32_t buffer[], const int width, const int height)
+	{
+	}
+
+	bool hasInput(const int player)
+	{
+		vassert(player==0 || player==1);
+		return false; // no joypad connected
+	}
+
+	void resetInput()
+	{
+	}
+
+	int readInput(const int player)
+	{
+		return 0;
+	}
+
+	int readInput(const int player, const int button)
+	{
+		return 0;
+	}
+
+	bool isForeground()
+	{
+		return true;
+	}
+
+	bool forceTerminate()
+	{
+		return false;
+	}
+
+	bool rewindRequired()
+	{
+		return false;
+	}
+
+	void limitFPS()
+	{
+	}
+
+	void onGameStart()
+	{
+	}
+
+	void onGameEnd()
+	{
+	}
+
+	void onFrameBegin()
+	{
+	}
+
+	void onFrameEnd()
+	{
+	}
+
+	void doEvents()
+	{
+	}
+}
@@ -69,7 +69,7 @@ TestResult TestFramework::runTestCase(TestCase *obj)
 	return result;
 }
 
-void TestFramework::runAll()
+TestResult TestFramework::runAll()
 {
 	bool ok = true;
 	puts("[+] runAll()");
@@ -89,6 +89,7 @@ void TestFramework::runAll()
 		puts("[-] ALL TEST CASES PASSED!");
 	}
 	puts("");
+	return ok ? SUCCESS : FAILED;
 }
 
 void TestFramework::deleteAll()
@@ -101,8 +102,8 @@ void TestFramework::deleteAll()
 }
 
 
-void TestFramework::assertion(const wchar_t * expression, const wchar_t * file, unsigned long line_number, TestCase * obj)
+void TestFramework::assertion(const char * expression, const char * file, unsigned long line_number, TestCase * obj)
 {
-	wprintf(L"[X] Assertion failed: %s\n[X] Location: %s: %ld\n", expression, file, line_number);
-	__debugbreak();
+	printf("[X] Assertion failed: %s\n[X] Location: %s: %ld\n", expression, file, line_number);
+	DEBUG_BREAK();
 }
\ No newline at end of file
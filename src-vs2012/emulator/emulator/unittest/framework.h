@@ -30,29 +30,19 @@ protected:
 	virtual void displayError() {}
 };
 
-template<class T>
-class TestCaseAutoRegister
-{
-public:
-	TestCaseAutoRegister()
-	{
-		TestFramework::instance().addTestCase(new T());
-	}
-};
-
 class TestFramework
 {
 public:
 	// test case manager
 	template <class TC> TestResult runTestCase();
 	TestResult runTestCase(TestCase *);
-	void runAll();
+	TestResult runAll();
 
 	void addTestCase(TestCase *);
 	void deleteAll();
 
 	// unit test utility
-	void assertion(const wchar_t *, const wchar_t *, unsigned long, TestCase * tc = nullptr);
+	void assertion(const char *, const char *, unsigned long, TestCase * tc = nullptr);
 
 	// singleton
 	static inline TestFramework& instance()
@@ -83,6 +73,16 @@ private:
 	TestFrameworkImpl *_pImpl;
 };
 
+template<class T>
+class TestCaseAutoRegister
+{
+public:
+	TestCaseAutoRegister()
+	{
+		TestFramework::instance().addTestCase(new T());
+	}
+};
+
 #define registerTestCase(C) static TestCaseAutoRegister<C> __ ## C ## _register
 
-#define tassert(E) if (!(E)) (framework().assertion(_CRT_WIDE(#E), _CRT_WIDE(__FILE__), __LINE__, this))
\ No newline at end of file
+#define tassert(E) if (!(E)) (framework().assertion(#E, __FILE__, __LINE__, this))
\ No newline at end of file